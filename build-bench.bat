@@ -0,0 +1,17 @@
+
+gcc ^
+  -DWIN32 ^
+  -mconsole ^
+  -std=c99 ^
+  -O3 ^
+  -Wall -Wextra ^
+  -Wno-missing-braces ^
+  -Wno-incompatible-pointer-types ^
+  -Isource ^
+  %* ^
+  source/*.c ^
+  source/bench/*.c ^
+  -pthread ^
+  -fwrapv ^
+  -fno-strict-aliasing ^
+  -o ship-bench.exe
@@ -0,0 +1,17 @@
+#!/usr/bin/env bash
+
+gcc \
+  -std=c99 \
+  -O3 \
+  -Wall -Wextra \
+  -Wno-missing-braces \
+  -Wno-incompatible-pointer-types \
+  -pthread \
+  -fwrapv \
+  -fno-strict-aliasing \
+  -Isource \
+  "$@" \
+  source/*.c \
+  source/bench/*.c \
+  -lm \
+  -o ship-bench
@@ -6,9 +6,13 @@ gcc \
   -Wall -Wextra \
   -Wno-missing-braces \
   -Wno-incompatible-pointer-types \
+  -pthread \
   -lglfw \
   -framework OpenGL \
   -fwrapv \
   -fno-strict-aliasing \
+  -Isource \
+  "$@" \
   source/*.c \
+  source/viewer/*.c \
   -o ship
@@ -8,10 +8,14 @@ gcc ^
   -Wall -Wextra ^
   -Wno-missing-braces ^
   -Wno-incompatible-pointer-types ^
+  -Isource ^
+  %* ^
   source/*.c ^
+  source/viewer/*.c ^
   -LC:\Dev\GLFW\lib ^
   -lglfw3 ^
   -lopengl32 ^
+  -pthread ^
   -fwrapv ^
   -fno-strict-aliasing ^
   -IC:\Dev\GLFW\include ^
@@ -6,9 +6,13 @@ gcc \
   -Wall -Wextra \
   -Wno-missing-braces \
   -Wno-incompatible-pointer-types \
+  -pthread \
   -lglfw \
   -lGL \
   -fwrapv \
   -fno-strict-aliasing \
+  -Isource \
+  "$@" \
   source/*.c \
+  source/viewer/*.c \
   -o ship
@@ -0,0 +1,555 @@
+#include "level.h"
+#include "model.h"
+#include "object.h"
+#include "search.h"
+#include "snapshot.h"
+#include "spotcache.h"
+#include "spots.h"
+#include "spotstore.h"
+#include "spotstream.h"
+#include "stats.h"
+#include "surface.h"
+#include "util.h"
+#include "verify.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Headless driver for the spot searches. Runs the chosen sweeps over a range
+// of indices and writes every spot found to a text file, one per line:
+//
+//   <sweep> <index> <x> <z> <y>
+//
+// where sweep is "pedro" or "volatile". Spots for each index are listed in
+// the order the search found them, and y is printed with enough digits to
+// read back the exact f32. --format binary or packed writes a spot stream
+// instead (see spotstream.h), which is smaller and exact.
+//
+// Each index's spots are written out, checked and dropped as soon as the
+// indices before it are done, so memory doesn't grow with the number of
+// indices (see runSearch).
+//
+// --roll also sweeps the ship's roll phase (v0F8), which the game never
+// advances. Each roll gets its own set of snapshots, built, searched and
+// written out before the next, so memory doesn't grow with the number of
+// rolls. The index printed is then the pose, roll * 0x100 + index.
+//
+// With --verify, the results are checked against a golden file instead (see
+// verify.h), and the exit status is nonzero if any pose differs.
+//
+// --store PREFIX also writes each sweep's spots as a SpotStore, in the spot
+// cache format (see spotcache.h), to PREFIX-<sweep>.bin. Spots that persist
+// across indices are stored once per run, which keeps full roll sweeps small.
+
+
+#define MAX_PLATFORMS 16
+
+#define FORMAT_TEXT 0
+#define FORMAT_BINARY 1
+#define FORMAT_PACKED 2
+
+
+typedef struct {
+  bool pedro;
+  bool volatileSpots;
+  s32 firstIndex;
+  s32 lastIndex;
+  s32 firstRoll;
+  s32 lastRoll;
+  s32 numThreads;
+  const char *outputPath;
+  s32 outputFormat;
+  const char *goldenPath;
+  const char *referencePath;
+  const char *writeGoldenPath;
+  const char *storePrefix;
+  const char *levelPath;
+  const char *modelPath;
+  s32 numPlatforms;
+  const char *platformSpecs[MAX_PLATFORMS];
+  SearchParams params;
+} BatchOptions;
+
+
+void printUsage(const char *prog) {
+  fprintf(stderr,
+    "Usage: %s [options]\n"
+    "  -s, --sweep pedro|volatile|both  sweeps to run (default pedro)\n"
+    "  -r, --range FIRST[-LAST]         index range (default 0-255)\n"
+    "  --roll FIRST[-LAST]              ship roll phases (default 0)\n"
+    "  -j, --threads N                  worker threads (default: all cpus)\n"
+    "  -o, --output PATH                output file (default spots.txt, or\n"
+    "                                   none with --verify/--write-golden)\n"
+    "  --format text|binary|packed      output format (default text)\n"
+    "  --verify GOLDEN                  check the results against GOLDEN\n"
+    "  --reference PATH                 spots from a known good run, to\n"
+    "                                   locate a --verify mismatch\n"
+    "  --write-golden PATH              write a golden file for the results\n"
+    "  --store PREFIX                   write compressed spot stores to\n"
+    "                                   PREFIX-<sweep>.bin\n"
+    "  --level PATH                     static level collision to load\n"
+    "                                   (see level.h; default none)\n"
+    "  --model PATH                     ship collision model file (see\n"
+    "                                   model.h; default built in)\n"
+    "  --platform NAME[:MODEL]          also load a platform, with its\n"
+    "                                   default or the given model\n"
+    "  --ceil-offset F                  Pedro ceiling check offset (%g)\n"
+    "  --max-clearance F                Pedro max ceiling clearance (%g)\n"
+    "  --min-drop F                     volatile min drop (%g)\n",
+    prog, PEDRO_CEIL_OFFSET, PEDRO_MAX_CLEARANCE, VOLATILE_MIN_DROP);
+
+  fprintf(stderr, "Platforms:");
+  for (s32 i = 0; i < numPlatformBehaviors; i++)
+    fprintf(stderr, " %s", platformBehaviors[i]->name);
+  fprintf(stderr, "\n");
+}
+
+
+bool parseFloat(const char *s, f32 *value) {
+  char *end;
+  f32 v = strtof(s, &end);
+  if (end == s || *end != '\0') return false;
+  *value = v;
+  return true;
+}
+
+
+bool parseOptions(int argc, char **argv, BatchOptions *opts) {
+  opts->pedro = true;
+  opts->volatileSpots = false;
+  opts->firstIndex = 0;
+  opts->lastIndex = 0xFF;
+  opts->firstRoll = 0;
+  opts->lastRoll = 0;
+  opts->numThreads = numCpus();
+  opts->outputPath = NULL;
+  opts->outputFormat = FORMAT_TEXT;
+  opts->goldenPath = NULL;
+  opts->referencePath = NULL;
+  opts->writeGoldenPath = NULL;
+  opts->storePrefix = NULL;
+  opts->levelPath = NULL;
+  opts->modelPath = NULL;
+  opts->numPlatforms = 0;
+  initSearchParams(&opts->params);
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+    if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+      return false;
+
+    if (value == NULL) {
+      fprintf(stderr, "Unknown option or missing value: %s\n", arg);
+      return false;
+    }
+    i += 1;
+
+    bool ok;
+    if (strcmp(arg, "-s") == 0 || strcmp(arg, "--sweep") == 0) {
+      ok = true;
+      if (strcmp(value, "pedro") == 0) {
+        opts->pedro = true;
+        opts->volatileSpots = false;
+      }
+      else if (strcmp(value, "volatile") == 0) {
+        opts->pedro = false;
+        opts->volatileSpots = true;
+      }
+      else if (strcmp(value, "both") == 0) {
+        opts->pedro = true;
+        opts->volatileSpots = true;
+      }
+      else
+        ok = false;
+    }
+    else if (strcmp(arg, "-r") == 0 || strcmp(arg, "--range") == 0)
+      ok = parseRange(value, &opts->firstIndex, &opts->lastIndex);
+    else if (strcmp(arg, "--roll") == 0)
+      ok = parseRange(value, &opts->firstRoll, &opts->lastRoll);
+    else if (strcmp(arg, "-j") == 0 || strcmp(arg, "--threads") == 0)
+      ok = parseInt(value, &opts->numThreads) && opts->numThreads > 0;
+    else if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) {
+      opts->outputPath = value;
+      ok = true;
+    }
+    else if (strcmp(arg, "--format") == 0) {
+      ok = true;
+      if (strcmp(value, "text") == 0)
+        opts->outputFormat = FORMAT_TEXT;
+      else if (strcmp(value, "binary") == 0)
+        opts->outputFormat = FORMAT_BINARY;
+      else if (strcmp(value, "packed") == 0)
+        opts->outputFormat = FORMAT_PACKED;
+      else
+        ok = false;
+    }
+    else if (strcmp(arg, "--verify") == 0) {
+      opts->goldenPath = value;
+      ok = true;
+    }
+    else if (strcmp(arg, "--reference") == 0) {
+      opts->referencePath = value;
+      ok = true;
+    }
+    else if (strcmp(arg, "--write-golden") == 0) {
+      opts->writeGoldenPath = value;
+      ok = true;
+    }
+    else if (strcmp(arg, "--store") == 0) {
+      opts->storePrefix = value;
+      ok = true;
+    }
+    else if (strcmp(arg, "--level") == 0) {
+      opts->levelPath = value;
+      ok = true;
+    }
+    else if (strcmp(arg, "--model") == 0) {
+      opts->modelPath = value;
+      ok = true;
+    }
+    else if (strcmp(arg, "--platform") == 0) {
+      ok = opts->numPlatforms < MAX_PLATFORMS;
+      if (ok)
+        opts->platformSpecs[opts->numPlatforms++] = value;
+    }
+    else if (strcmp(arg, "--ceil-offset") == 0)
+      ok = parseFloat(value, &opts->params.pedroCeilOffset);
+    else if (strcmp(arg, "--max-clearance") == 0)
+      ok = parseFloat(value, &opts->params.pedroMaxClearance);
+    else if (strcmp(arg, "--min-drop") == 0)
+      ok = parseFloat(value, &opts->params.volatileMinDrop);
+    else {
+      fprintf(stderr, "Unknown option: %s\n", arg);
+      return false;
+    }
+
+    if (!ok) {
+      fprintf(stderr, "Invalid value for %s: %s\n", arg, value);
+      return false;
+    }
+  }
+
+  if (opts->outputPath == NULL && opts->goldenPath == NULL &&
+    opts->writeGoldenPath == NULL && opts->storePrefix == NULL)
+  {
+    opts->outputPath = "spots.txt";
+  }
+  return true;
+}
+
+
+bool writeSpots(FILE *f, const char *sweep, s32 pose, SpotBuffer *spots) {
+  for (s32 i = 0; i < spots->count; i++) {
+    Spot *s = &spots->spots[i];
+    if (fprintf(f, "%s %d %d %d %.9g\n", sweep, pose, s->x, s->z, s->y) < 0)
+      return false;
+  }
+  return true;
+}
+
+
+// Initializes a platform from NAME[:MODEL]. The model path, or NULL for the
+// behavior's default model, goes in modelPath.
+bool initPlatformFromSpec(Object *o, const char *spec, const char **modelPath) {
+  char name[64];
+  const char *colon = strchr(spec, ':');
+  size_t nameLength = colon != NULL ? (size_t) (colon - spec) : strlen(spec);
+  if (nameLength >= sizeof(name)) nameLength = sizeof(name) - 1;
+  memcpy(name, spec, nameLength);
+  name[nameLength] = '\0';
+
+  const PlatformBehavior *behavior = findPlatformBehavior(name);
+  if (behavior == NULL) {
+    fprintf(stderr, "Unknown platform: %s\n", name);
+    return false;
+  }
+
+  initPlatform(o, behavior);
+  *modelPath = colon != NULL ? colon + 1 : NULL;
+  return true;
+}
+
+
+typedef struct {
+  bool enabled;
+  const char *name;
+  SpotSearch search;
+  GoldenCheck golden;
+  SpotStoreBuilder store;
+  s64 numSpots;
+} Sweep;
+
+
+// Where the results go. Write errors are remembered until the files are
+// closed.
+typedef struct {
+  FILE *spots;
+  SpotStreamWriter stream; // for the binary formats
+  bool spotsOk;
+  FILE *golden;
+  bool goldenOk;
+} BatchOutput;
+
+
+typedef struct {
+  Sweep *sweep;
+  BatchOptions *opts;
+  BatchOutput *output;
+  s32 roll;
+  bool printCounts;
+  s32 numMismatched;
+  bool failed;
+} SweepSink;
+
+
+// Writes out and checks the spots of one index as soon as it's searched
+void sinkSweepSpots(void *data, s32 index, SpotBuffer *spots) {
+  SweepSink *sink = (SweepSink *) data;
+  Sweep *sweep = sink->sweep;
+  BatchOptions *opts = sink->opts;
+  BatchOutput *out = sink->output;
+  s32 pose = shipPoseIndex(sink->roll, index);
+
+  if (sink->printCounts) {
+    printf("Index %d: %d\n", index, spots->count);
+    fflush(stdout);
+  }
+
+  if (out->spots != NULL && out->spotsOk) {
+    if (opts->outputFormat == FORMAT_TEXT)
+      out->spotsOk = writeSpots(out->spots, sweep->name, pose, spots);
+    else
+      out->spotsOk = writeSpotRecord(&out->stream, sweep->name, pose,
+        spots->spots, spots->count);
+  }
+  if (out->golden != NULL && out->goldenOk)
+    out->goldenOk = writeGolden(out->golden, sweep->name, pose, spots);
+
+  if (opts->goldenPath != NULL && !sink->failed) {
+    s32 n = verifyGolden(&sweep->golden, pose, spots);
+    if (n < 0)
+      sink->failed = true;
+    else
+      sink->numMismatched += n;
+  }
+
+  if (opts->storePrefix != NULL)
+    addStoreSpots(&sweep->store, pose, spots->spots, spots->count);
+  sweep->numSpots += spots->count;
+}
+
+
+// Runs the sweep for one set of snapshots. Returns the number of poses that
+// differ from the golden file, or -1 if it couldn't be checked.
+s32 runSweep(
+  Sweep *sweep,
+  ShipSnapshots *snapshots,
+  BatchOptions *opts,
+  s32 roll,
+  bool printCounts,
+  BatchOutput *output)
+{
+  if (printCounts)
+    printf("Computing %s spots\n", sweep->name);
+
+  SweepSink sink = { sweep, opts, output, roll, printCounts, 0, false };
+  runSearch(sweep->search, snapshots, &opts->params, opts->firstIndex,
+    opts->lastIndex, opts->numThreads, sinkSweepSpots, &sink);
+  return sink.failed ? -1 : sink.numMismatched;
+}
+
+
+FILE *openOutput(const char *path, const char *mode) {
+  if (path == NULL) return NULL;
+
+  FILE *f = fopen(path, mode);
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    exit(1);
+  }
+  return f;
+}
+
+
+// Writes PREFIX-<sweep>.bin
+bool writeStore(const char *prefix, Sweep *sweep) {
+  SpotStore store;
+  finishSpotStore(&sweep->store, &store);
+
+  char path[1024];
+  snprintf(path, sizeof(path), "%s-%s.bin", prefix, sweep->name);
+  bool ok = writeSpotCache(path, 0, &store);
+  if (ok)
+    printf("Wrote %s (%d runs, %llu bytes)\n", path, store.numRuns,
+      (unsigned long long) (sizeof(SpotCacheHeader) + store.size));
+  else
+    fprintf(stderr, "Failed to write %s\n", path);
+
+  freeSpotStore(&store);
+  return ok;
+}
+
+
+bool closeOutput(FILE *f, const char *path, bool ok) {
+  if (f == NULL) return true;
+
+  if (fclose(f) != 0 || !ok) {
+    fprintf(stderr, "Failed to write %s\n", path);
+    return false;
+  }
+  printf("Wrote %s\n", path);
+  return true;
+}
+
+
+int main(int argc, char **argv) {
+  BatchOptions opts;
+  if (!parseOptions(argc, argv, &opts)) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  // Opened first so a bad path fails before the sweeps rather than after
+  BatchOutput output = {0};
+  bool binary = opts.outputFormat != FORMAT_TEXT;
+  output.spots = openOutput(opts.outputPath, binary ? "wb" : "w");
+  output.spotsOk = true;
+  if (output.spots != NULL && binary) {
+    output.spotsOk = initSpotStreamWriter(&output.stream, output.spots,
+      opts.outputFormat == FORMAT_PACKED);
+  }
+  output.golden = openOutput(opts.writeGoldenPath, "w");
+  output.goldenOk = true;
+
+  LevelCollision *level = NULL;
+  if (opts.levelPath != NULL) {
+    level = loadLevelCollision(opts.levelPath);
+    if (level == NULL) return 1;
+    printf("Loaded %d static surfaces from %s\n",
+      level->world->numStaticSurfaces, opts.levelPath);
+  }
+
+  // The ship comes first, then the extra platforms
+  Object platforms[1 + MAX_PLATFORMS];
+  CollisionModelFile models[1 + MAX_PLATFORMS];
+  const char *modelPaths[1 + MAX_PLATFORMS];
+  s32 numPlatforms = 1 + opts.numPlatforms;
+
+  initJrbShipAfloat(&platforms[0]);
+  modelPaths[0] = opts.modelPath;
+  for (s32 i = 1; i < numPlatforms; i++) {
+    const char *spec = opts.platformSpecs[i - 1];
+    if (!initPlatformFromSpec(&platforms[i], spec, &modelPaths[i]))
+      return 1;
+  }
+
+  for (s32 i = 0; i < numPlatforms; i++) {
+    if (modelPaths[i] == NULL) continue;
+    if (!mapCollisionModel(&models[i], modelPaths[i])) return 1;
+    platforms[i].collisionModel = models[i].model;
+    printf("Loaded %d triangles from %s\n", models[i].numTris, modelPaths[i]);
+  }
+
+  Sweep sweeps[] = {
+    { opts.pedro, "pedro", findPedroSpots, {0}, {0}, 0 },
+    { opts.volatileSpots, "volatile", findVolatileSpots, {0}, {0}, 0 },
+  };
+  s32 numSweeps = sizeof(sweeps) / sizeof(sweeps[0]);
+
+  for (s32 i = 0; i < numSweeps; i++) {
+    if (!sweeps[i].enabled || opts.goldenPath == NULL) continue;
+    if (!initGoldenCheck(&sweeps[i].golden,
+      opts.goldenPath, opts.referencePath, sweeps[i].name))
+    {
+      return 1;
+    }
+  }
+
+  for (s32 i = 0; i < numSweeps; i++) {
+    if (sweeps[i].enabled && opts.storePrefix != NULL)
+      initSpotStoreBuilder(&sweeps[i].store,
+        shipPoseIndex(opts.lastRoll, 0xFF) + 1);
+  }
+
+  s32 numMismatched = 0;
+
+  // With more than one roll, progress is reported per roll instead of per
+  // index
+  s32 numRolls = opts.lastRoll - opts.firstRoll + 1;
+  bool printCounts = numRolls == 1;
+  f64 startNs = nowNs();
+
+  initStaticPartition();
+
+  for (s32 roll = opts.firstRoll; roll <= opts.lastRoll; roll++) {
+    setPlatformFixedPhase(&platforms[0], roll);
+    ShipSnapshots *snapshots =
+      buildPlatformSnapshots(platforms, numPlatforms, level);
+
+    for (s32 i = 0; i < numSweeps; i++) {
+      if (!sweeps[i].enabled) continue;
+      s32 n = runSweep(&sweeps[i], snapshots, &opts, roll, printCounts,
+        &output);
+      if (n < 0) return 1;
+      numMismatched += n;
+    }
+
+    freeShipSnapshots(snapshots);
+
+    if (!printCounts) {
+      s32 numDone = roll - opts.firstRoll + 1;
+      f64 elapsed = (nowNs() - startNs) / 1e9;
+      printf("Roll %d (%d/%d):", roll, numDone, numRolls);
+      for (s32 i = 0; i < numSweeps; i++) {
+        if (sweeps[i].enabled)
+          printf(" %lld %s,",
+            (long long) sweeps[i].numSpots, sweeps[i].name);
+      }
+      printf(" %.0f s elapsed, %.0f s left\n",
+        elapsed, elapsed / numDone * (numRolls - numDone));
+      fflush(stdout);
+    }
+  }
+
+  if (binary && output.spots != NULL)
+    freeSpotStreamWriter(&output.stream);
+  if (!closeOutput(output.spots, opts.outputPath, output.spotsOk) ||
+    !closeOutput(output.golden, opts.writeGoldenPath, output.goldenOk))
+  {
+    return 1;
+  }
+
+  for (s32 i = 0; i < numSweeps; i++) {
+    if (sweeps[i].enabled && opts.storePrefix != NULL &&
+      !writeStore(opts.storePrefix, &sweeps[i]))
+    {
+      return 1;
+    }
+  }
+
+  for (s32 i = 0; i < numSweeps; i++) {
+    if (sweeps[i].enabled && opts.goldenPath != NULL)
+      freeGoldenCheck(&sweeps[i].golden);
+  }
+  if (level != NULL)
+    freeLevelCollision(level);
+  for (s32 i = 0; i < numPlatforms; i++) {
+    if (modelPaths[i] != NULL)
+      unmapCollisionModel(&models[i]);
+  }
+  printStats(stdout);
+
+  if (opts.goldenPath != NULL) {
+    if (numMismatched > 0) {
+      printf("FAILED: %d poses differ from %s\n",
+        numMismatched, opts.goldenPath);
+      return 1;
+    }
+    printf("OK: all poses match %s\n", opts.goldenPath);
+  }
+  return 0;
+}
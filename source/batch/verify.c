@@ -0,0 +1,258 @@
+#include "verify.h"
+
+#include "snapshot.h"
+#include "spots.h"
+#include "spotstream.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static u64 spotKey(const Spot *s) {
+  u32 ybits;
+  memcpy(&ybits, &s->y, sizeof(ybits));
+  return (u64) (u16) s->x << 48 | (u64) (u16) s->z << 32 | ybits;
+}
+
+
+// splitmix64 finalizer
+static u64 mixKey(u64 k) {
+  k ^= k >> 30;
+  k *= 0xBF58476D1CE4E5B9ull;
+  k ^= k >> 27;
+  k *= 0x94D049BB133111EBull;
+  k ^= k >> 31;
+  return k;
+}
+
+
+u64 hashSpotSet(const Spot *spots, s32 count) {
+  u64 hash = 0;
+  for (s32 i = 0; i < count; i++)
+    hash += mixKey(spotKey(&spots[i]));
+  return hash;
+}
+
+
+bool writeGolden(FILE *f, const char *sweep, s32 pose, SpotBuffer *spots) {
+  u64 hash = hashSpotSet(spots->spots, spots->count);
+  return fprintf(f, "%s %d %d %016llx\n",
+    sweep, pose, spots->count, (unsigned long long) hash) >= 0;
+}
+
+
+static bool readGolden(
+  const char *path, const char *sweep, GoldenEntry *entries)
+{
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return false;
+  }
+
+  for (s32 i = 0; i < NUM_SHIP_POSES; i++)
+    entries[i].present = false;
+
+  char line[256];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char name[32];
+    s32 index, count;
+    unsigned long long hash;
+
+    if (line[0] == '#' || line[0] == '\n') continue;
+    if (sscanf(line, "%31s %d %d %llx", name, &index, &count, &hash) != 4 ||
+      index < 0 || index >= NUM_SHIP_POSES)
+    {
+      fprintf(stderr, "Bad line in %s: %s", path, line);
+      fclose(f);
+      return false;
+    }
+
+    if (strcmp(name, sweep) == 0) {
+      entries[index].present = true;
+      entries[index].count = count;
+      entries[index].hash = hash;
+    }
+  }
+
+  fclose(f);
+  return true;
+}
+
+
+static bool readReferenceStream(
+  SpotStreamReader *r,
+  const char *path,
+  const char *sweep,
+  s32 pose,
+  SpotBuffer *spots)
+{
+  SpotBuffer record;
+  initSpotBuffer(&record);
+
+  s32 result;
+  while ((result = readSpotRecord(r, &record)) > 0) {
+    if (r->pose == pose && strcmp(r->sweep, sweep) == 0)
+      appendSpots(spots, record.spots, record.count);
+  }
+  if (result < 0)
+    fprintf(stderr, "Bad record in %s\n", path);
+
+  freeSpotBuffer(&record);
+  return result == 0;
+}
+
+
+// Reads the spots of one sweep and pose from a ship-batch output file, in
+// either format
+static bool readReferenceSpots(
+  const char *path, const char *sweep, s32 pose, SpotBuffer *spots)
+{
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return false;
+  }
+
+  SpotStreamReader r;
+  if (initSpotStreamReader(&r, f)) {
+    bool ok = readReferenceStream(&r, path, sweep, pose, spots);
+    freeSpotStreamReader(&r);
+    fclose(f);
+    return ok;
+  }
+
+  char line[256];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char name[32];
+    s32 i, x, z;
+    f32 y;
+
+    if (sscanf(line, "%31s %d %d %d %f", name, &i, &x, &z, &y) != 5) {
+      fprintf(stderr, "Bad line in %s: %s", path, line);
+      fclose(f);
+      return false;
+    }
+
+    if (i == pose && strcmp(name, sweep) == 0)
+      pushSpot(spots, (s16) x, (s16) z, y);
+  }
+
+  fclose(f);
+  return true;
+}
+
+
+static int compareSpots(const void *a, const void *b) {
+  u64 ka = spotKey((const Spot *) a);
+  u64 kb = spotKey((const Spot *) b);
+  return ka < kb ? -1 : ka > kb ? 1 : 0;
+}
+
+
+// Sorts both sets by (x, z, y) and reports the first spot in one but not the
+// other
+static bool reportFirstDifference(
+  const char *referencePath,
+  const char *sweep,
+  s32 pose,
+  SpotBuffer *actual)
+{
+  SpotBuffer expected;
+  initSpotBuffer(&expected);
+  if (!readReferenceSpots(referencePath, sweep, pose, &expected)) {
+    freeSpotBuffer(&expected);
+    return false;
+  }
+
+  SpotBuffer sorted;
+  initSpotBuffer(&sorted);
+  appendSpots(&sorted, actual->spots, actual->count);
+
+  qsort(expected.spots, expected.count, sizeof(Spot), compareSpots);
+  qsort(sorted.spots, sorted.count, sizeof(Spot), compareSpots);
+
+  s32 i = 0;
+  while (i < expected.count && i < sorted.count &&
+    compareSpots(&expected.spots[i], &sorted.spots[i]) == 0)
+  {
+    i++;
+  }
+
+  if (i == expected.count && i == sorted.count) {
+    printf("  %s pose %d matches %s; the golden file may be stale\n",
+      sweep, pose, referencePath);
+  }
+  else {
+    bool missing = i < expected.count && (i == sorted.count ||
+      compareSpots(&expected.spots[i], &sorted.spots[i]) < 0);
+    Spot *s = missing ? &expected.spots[i] : &sorted.spots[i];
+
+    printf("  first difference: pose %d, x = %d, z = %d (%s, y = %.9g)\n",
+      pose, s->x, s->z,
+      missing ? "missing" : "unexpected", s->y);
+  }
+
+  freeSpotBuffer(&sorted);
+  freeSpotBuffer(&expected);
+  return true;
+}
+
+
+bool initGoldenCheck(
+  GoldenCheck *check,
+  const char *goldenPath,
+  const char *referencePath,
+  const char *sweep)
+{
+  GoldenEntry *entries =
+    (GoldenEntry *) malloc(NUM_SHIP_POSES * sizeof(GoldenEntry));
+  if (entries == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  if (!readGolden(goldenPath, sweep, entries)) {
+    free(entries);
+    return false;
+  }
+
+  check->goldenPath = goldenPath;
+  check->referencePath = referencePath;
+  check->sweep = sweep;
+  check->entries = entries;
+  check->reported = false;
+  return true;
+}
+
+
+void freeGoldenCheck(GoldenCheck *check) {
+  free(check->entries);
+  check->entries = NULL;
+}
+
+
+s32 verifyGolden(GoldenCheck *check, s32 pose, SpotBuffer *spots) {
+  GoldenEntry *e = &check->entries[pose];
+
+  if (!e->present) {
+    printf("%s pose %d: not in %s\n", check->sweep, pose, check->goldenPath);
+    return 1;
+  }
+
+  u64 hash = hashSpotSet(spots->spots, spots->count);
+  if (spots->count == e->count && hash == e->hash) return 0;
+
+  printf("%s pose %d: %d spots (hash %016llx), "
+    "expected %d (hash %016llx)\n",
+    check->sweep, pose, spots->count, (unsigned long long) hash,
+    e->count, (unsigned long long) e->hash);
+
+  if (check->referencePath != NULL && !check->reported) {
+    if (!reportFirstDifference(check->referencePath, check->sweep, pose, spots))
+      return -1;
+    check->reported = true;
+  }
+  return 1;
+}
@@ -0,0 +1,61 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+
+#include "spots.h"
+#include "util.h"
+
+#include <stdio.h>
+
+
+// Golden files record, for each sweep and pose, the number of spots and a
+// hash of the spot set, one line each:
+//
+//   <sweep> <pose> <count> <hash>
+//
+// where pose is roll * 0x100 + index (see shipPoseIndex), which is just the
+// index at roll 0. The hash doesn't depend on the order the spots were found
+// in, so searches that visit points in a different order still verify. y is
+// hashed by its bits, so any change in float behavior shows up.
+//
+// Hashes can only say which pose differs. To find the first differing spot,
+// a reference spot file written by a known good build (ship-batch -o, as text
+// or a spot stream) can be given as well.
+
+
+typedef struct {
+  bool present;
+  s32 count;
+  u64 hash;
+} GoldenEntry;
+
+
+// The golden entries of one sweep, read once and then checked a pose at a
+// time. Only the first mismatch is looked up in the reference file.
+typedef struct {
+  const char *goldenPath;
+  const char *referencePath;
+  const char *sweep;
+  GoldenEntry *entries; // NUM_SHIP_POSES, indexed by pose
+  bool reported;
+} GoldenCheck;
+
+
+u64 hashSpotSet(const Spot *spots, s32 count);
+
+bool writeGolden(FILE *f, const char *sweep, s32 pose, SpotBuffer *spots);
+
+// Reads the entries for sweep from goldenPath. referencePath may be NULL.
+bool initGoldenCheck(
+  GoldenCheck *check,
+  const char *goldenPath,
+  const char *referencePath,
+  const char *sweep);
+void freeGoldenCheck(GoldenCheck *check);
+
+// Returns 0 if the spots match the golden entry for pose, 1 if they don't, or
+// -1 if the reference file couldn't be read
+s32 verifyGolden(GoldenCheck *check, s32 pose, SpotBuffer *spots);
+
+
+#endif
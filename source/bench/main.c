@@ -0,0 +1,505 @@
+#include "heightmap.h"
+#include "object.h"
+#include "search.h"
+#include "snapshot.h"
+#include "spots.h"
+#include "stats.h"
+#include "surface.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Times the collision queries, model loading, height map rasterization and
+// the per-index searches against the ship snapshots. Each benchmark collects
+// a number of samples and reports ns/op percentiles over them. Query samples
+// time a chunk of QUERY_CHUNK queries, since a single query is close to the
+// timer's resolution; every other sample times a single operation.
+//
+// Results are printed as a table, and with -o also written as CSV with the
+// columns:
+//
+//   benchmark,samples,ops_per_sample,mean_ns,p50_ns,p90_ns,p99_ns,min_ns,max_ns
+//
+// Query points come from a fixed seed, so runs are comparable.
+
+
+#define QUERY_CHUNK 256
+#define NUM_QUERY_POINTS 0x10000
+
+
+typedef struct {
+  s32 sweepStride;
+  u32 seed;
+  const char *csvPath;
+} BenchOptions;
+
+
+typedef struct {
+  f64 *ns;
+  s32 count;
+  s32 capacity;
+  s32 opsPerSample;
+} Samples;
+
+
+FILE *csvFile;
+volatile f32 sink;
+
+
+void initSamples(Samples *s, s32 capacity, s32 opsPerSample) {
+  s->ns = (f64 *) malloc(capacity * sizeof(f64));
+  if (s->ns == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  s->count = 0;
+  s->capacity = capacity;
+  s->opsPerSample = opsPerSample;
+}
+
+
+void addSample(Samples *s, f64 startNs, f64 endNs) {
+  if (s->count < s->capacity)
+    s->ns[s->count++] = (endNs - startNs) / s->opsPerSample;
+}
+
+
+int compareF64(const void *a, const void *b) {
+  f64 x = *(const f64 *) a;
+  f64 y = *(const f64 *) b;
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+
+f64 percentile(Samples *s, s32 p) {
+  return s->ns[(s64) (s->count - 1) * p / 100];
+}
+
+
+void report(const char *name, Samples *s) {
+  if (s->count == 0) {
+    free(s->ns);
+    return;
+  }
+
+  qsort(s->ns, s->count, sizeof(f64), compareF64);
+
+  f64 total = 0;
+  for (s32 i = 0; i < s->count; i++)
+    total += s->ns[i];
+  f64 mean = total / s->count;
+
+  printf("%-22s %7d %6d %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f\n",
+    name, s->count, s->opsPerSample, mean,
+    percentile(s, 50), percentile(s, 90), percentile(s, 99),
+    s->ns[0], s->ns[s->count - 1]);
+  fflush(stdout);
+
+  if (csvFile != NULL) {
+    fprintf(csvFile, "%s,%d,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+      name, s->count, s->opsPerSample, mean,
+      percentile(s, 50), percentile(s, 90), percentile(s, 99),
+      s->ns[0], s->ns[s->count - 1]);
+  }
+
+  free(s->ns);
+}
+
+
+u32 nextRandom(u32 *state) {
+  u32 x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+
+f32 randomInRange(u32 *state, f32 lo, f32 hi) {
+  return lo + (hi - lo) * (f32) ((nextRandom(state) >> 8) / (f64) 0x1000000);
+}
+
+
+// Bounding box of the ship over all indices, padded so that some queries miss
+void getShipBounds(ShipSnapshots *snapshots, v3f *lo, v3f *hi) {
+  *lo = (v3f) { 1e9f, 1e9f, 1e9f };
+  *hi = (v3f) { -1e9f, -1e9f, -1e9f };
+
+  for (s32 i = 0; i < 0x100; i++) {
+    CollisionWorld *world = shipSnapshotWorld(snapshots, i);
+    for (s32 j = 0; j < world->surfacesAllocated; j++) {
+      Surface *s = worldSurface(world, j);
+      v3h vs[3] = { s->vertex1, s->vertex2, s->vertex3 };
+      for (s32 k = 0; k < 3; k++) {
+        if (vs[k].x < lo->x) lo->x = vs[k].x;
+        if (vs[k].y < lo->y) lo->y = vs[k].y;
+        if (vs[k].z < lo->z) lo->z = vs[k].z;
+        if (vs[k].x > hi->x) hi->x = vs[k].x;
+        if (vs[k].y > hi->y) hi->y = vs[k].y;
+        if (vs[k].z > hi->z) hi->z = vs[k].z;
+      }
+    }
+  }
+
+  f32 pad = 200.0f;
+  lo->x -= pad;
+  lo->y -= pad;
+  lo->z -= pad;
+  hi->x += pad;
+  hi->y += pad;
+  hi->z += pad;
+}
+
+
+void randomPoints(v3f *pts, s32 n, v3f lo, v3f hi, u32 seed) {
+  u32 state = seed != 0 ? seed : 1;
+  for (s32 i = 0; i < n; i++) {
+    pts[i].x = randomInRange(&state, lo.x, hi.x);
+    pts[i].y = randomInRange(&state, lo.y, hi.y);
+    pts[i].z = randomInRange(&state, lo.z, hi.z);
+  }
+}
+
+
+// 64 x 16 x 64 grid over the bounds, in x-major order so that consecutive
+// points are close together like in the searches
+void gridPoints(v3f *pts, v3f lo, v3f hi) {
+  s32 i = 0;
+  for (s32 iz = 0; iz < 64; iz++) {
+    for (s32 iy = 0; iy < 16; iy++) {
+      for (s32 ix = 0; ix < 64; ix++) {
+        pts[i].x = lo.x + (hi.x - lo.x) * ix / 63.0f;
+        pts[i].y = lo.y + (hi.y - lo.y) * iy / 15.0f;
+        pts[i].z = lo.z + (hi.z - lo.z) * iz / 63.0f;
+        i++;
+      }
+    }
+  }
+}
+
+
+typedef f32 (*Query)(CollisionWorld *world, v3f p);
+
+
+f32 queryFloor(CollisionWorld *world, v3f p) {
+  Surface *floor;
+  return worldFindFloor(world, p, &floor);
+}
+
+
+f32 queryCeil(CollisionWorld *world, v3f p) {
+  Surface *ceil;
+  return worldFindCeil(world, p, &ceil);
+}
+
+
+// Mario's wall check at his body height
+f32 queryWalls(CollisionWorld *world, v3f p) {
+  CollisionData data;
+  data.pos = p;
+  data.offsetY = 60.0f;
+  data.radius = 50.0f;
+  data.numSurfaces = 0;
+  return (f32) worldFindWallCols(world, &data) + data.pos.x;
+}
+
+
+// Each chunk of points runs against the next snapshot, so the samples cover
+// the ship's range of motion
+void benchQuery(
+  const char *name, Query query, ShipSnapshots *snapshots, v3f *pts)
+{
+  s32 numChunks = NUM_QUERY_POINTS / QUERY_CHUNK;
+  Samples s;
+  initSamples(&s, numChunks, QUERY_CHUNK);
+
+  f32 acc = 0;
+  for (s32 i = 0; i < QUERY_CHUNK; i++)
+    acc += query(shipSnapshotWorld(snapshots, 0), pts[i]);
+
+  for (s32 c = 0; c < numChunks; c++) {
+    CollisionWorld *world = shipSnapshotWorld(snapshots, c);
+    v3f *chunk = &pts[c * QUERY_CHUNK];
+
+    f64 start = nowNs();
+    for (s32 i = 0; i < QUERY_CHUNK; i++)
+      acc += query(world, chunk[i]);
+    addSample(&s, start, nowNs());
+  }
+
+  sink = acc;
+  report(name, &s);
+}
+
+
+void benchLoadModel(ShipSnapshots *snapshots) {
+  CollisionWorld *world = newCollisionWorld();
+  if (world == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  Samples s;
+  initSamples(&s, 4 * 0x100, 1);
+
+  for (s32 round = 0; round < 4; round++) {
+    for (s32 i = 0; i < 0x100; i++) {
+      Object *o = shipSnapshotObject(snapshots, i);
+
+      f64 start = nowNs();
+      worldInitDynamicPartition(world);
+      worldLoadObjectCollisionModel(world, o);
+      addSample(&s, start, nowNs());
+    }
+  }
+
+  freeCollisionWorld(world);
+  report("loadModel", &s);
+}
+
+
+bool sameSurface(Surface *a, Surface *b) {
+  return a->type == b->type && a->v02 == b->v02 && a->v04 == b->v04 &&
+    a->v05 == b->v05 && a->lowerY == b->lowerY && a->upperY == b->upperY &&
+    a->vertex1.x == b->vertex1.x && a->vertex1.y == b->vertex1.y &&
+    a->vertex1.z == b->vertex1.z && a->vertex2.x == b->vertex2.x &&
+    a->vertex2.y == b->vertex2.y && a->vertex2.z == b->vertex2.z &&
+    a->vertex3.x == b->vertex3.x && a->vertex3.y == b->vertex3.y &&
+    a->vertex3.z == b->vertex3.z && a->normal.x == b->normal.x &&
+    a->normal.y == b->normal.y && a->normal.z == b->normal.z &&
+    a->originOffset == b->originOffset && a->object == b->object;
+}
+
+
+// Whether two worlds have the same dynamic surfaces, in the same pool slots,
+// and the same dynamic partition lists
+bool sameDynamicSurfaces(CollisionWorld *a, CollisionWorld *b) {
+  if (a->surfacesAllocated != b->surfacesAllocated) return false;
+  for (s32 i = a->numStaticSurfaces; i < a->surfacesAllocated; i++) {
+    if (!sameSurface(worldSurface(a, i), worldSurface(b, i))) return false;
+  }
+
+  for (s32 cell = 0; cell < 16 * 16; cell++) {
+    for (s32 type = 0; type < 3; type++) {
+      SurfaceNode *na = a->dynamicPartition[cell].lists[type].tail;
+      SurfaceNode *nb = b->dynamicPartition[cell].lists[type].tail;
+      while (na != NULL && nb != NULL) {
+        if (worldSurfaceIndex(a, na->head) != worldSurfaceIndex(b, nb->head))
+          return false;
+        na = na->tail;
+        nb = nb->tail;
+      }
+      if (na != nb) return false;
+    }
+  }
+
+  return true;
+}
+
+
+// Steps one world through every index with worldUpdateObjectCollisionModel,
+// and checks each pose against a full reload
+void benchUpdateModel(ShipSnapshots *snapshots) {
+  CollisionWorld *world = newCollisionWorld();
+  CollisionWorld *reference = newCollisionWorld();
+  if (world == NULL || reference == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  Samples s;
+  initSamples(&s, 4 * 0x100, 1);
+
+  for (s32 round = 0; round < 4; round++) {
+    for (s32 i = 0; i < 0x100; i++) {
+      Object *o = shipSnapshotObject(snapshots, i);
+
+      f64 start = nowNs();
+      worldUpdateObjectCollisionModel(world, o);
+      addSample(&s, start, nowNs());
+
+      worldInitDynamicPartition(reference);
+      worldLoadObjectCollisionModel(reference, o);
+      if (!sameDynamicSurfaces(world, reference)) {
+        fprintf(stderr, "updateModel: index %d differs from a full reload\n",
+          i);
+        exit(1);
+      }
+    }
+  }
+
+  freeCollisionWorld(world);
+  freeCollisionWorld(reference);
+  report("updateModel", &s);
+}
+
+
+// Rasterizes the floors of each index, as findPedroSpots does
+void benchHeightMaps(ShipSnapshots *snapshots, s32 stride) {
+  HeightMapStore maps;
+  initHeightMapStore(&maps);
+
+  Samples s;
+  initSamples(&s, 0x100, 1);
+
+  for (s32 i = 0; i < 0x100; i += stride) {
+    CollisionWorld *world = shipSnapshotWorld(snapshots, i);
+
+    f64 start = nowNs();
+    resetHeightMapStore(&maps, world);
+    for (s32 j = 0; j < world->surfacesAllocated; j++) {
+      if (classifySurface(worldSurface(world, j)) == 'f')
+        getSurfaceHeightMap(&maps, j);
+    }
+    addSample(&s, start, nowNs());
+  }
+
+  freeHeightMapStore(&maps);
+  report("heightMaps", &s);
+}
+
+
+void benchSearch(
+  const char *name,
+  SpotSearch search,
+  ShipSnapshots *snapshots,
+  s32 stride)
+{
+  SearchParams params;
+  initSearchParams(&params);
+
+  HeightMapStore maps;
+  initHeightMapStore(&maps);
+
+  SpotBuffer spots;
+  initSpotBuffer(&spots);
+
+  Samples s;
+  initSamples(&s, 0x100, 1);
+
+  for (s32 i = 0; i < 0x100; i += stride) {
+    clearSpotBuffer(&spots);
+
+    f64 start = nowNs();
+    search(snapshots, &params, i, &maps, &spots);
+    addSample(&s, start, nowNs());
+  }
+
+  freeSpotBuffer(&spots);
+  freeHeightMapStore(&maps);
+  report(name, &s);
+}
+
+
+void printUsage(const char *prog) {
+  fprintf(stderr,
+    "Usage: %s [options]\n"
+    "  -s, --stride N    index stride for the per-index benchmarks "
+    "(default 16)\n"
+    "  --seed N          seed for the random query points (default 1)\n"
+    "  -o, --output PATH also write the results as CSV\n",
+    prog);
+}
+
+
+bool parseOptions(int argc, char **argv, BenchOptions *opts) {
+  opts->sweepStride = 16;
+  opts->seed = 1;
+  opts->csvPath = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (value == NULL) return false;
+    i += 1;
+
+    bool ok;
+    if (strcmp(arg, "-s") == 0 || strcmp(arg, "--stride") == 0)
+      ok = parseInt(value, &opts->sweepStride) && opts->sweepStride > 0;
+    else if (strcmp(arg, "--seed") == 0) {
+      s32 seed;
+      ok = parseInt(value, &seed) && seed >= 0;
+      if (ok) opts->seed = (u32) seed;
+    }
+    else if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) {
+      opts->csvPath = value;
+      ok = true;
+    }
+    else
+      return false;
+
+    if (!ok) {
+      fprintf(stderr, "Invalid value for %s: %s\n", arg, value);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+int main(int argc, char **argv) {
+  BenchOptions opts;
+  if (!parseOptions(argc, argv, &opts)) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  if (opts.csvPath != NULL) {
+    csvFile = fopen(opts.csvPath, "w");
+    if (csvFile == NULL) {
+      fprintf(stderr, "Failed to open %s\n", opts.csvPath);
+      return 1;
+    }
+    fprintf(csvFile, "benchmark,samples,ops_per_sample,"
+      "mean_ns,p50_ns,p90_ns,p99_ns,min_ns,max_ns\n");
+  }
+
+  Object ship;
+  initJrbShipAfloat(&ship);
+  initStaticPartition();
+  ShipSnapshots *snapshots = buildShipSnapshots(&ship, NULL);
+
+  v3f lo, hi;
+  getShipBounds(snapshots, &lo, &hi);
+
+  v3f *randomPts = (v3f *) malloc(NUM_QUERY_POINTS * sizeof(v3f));
+  v3f *gridPts = (v3f *) malloc(NUM_QUERY_POINTS * sizeof(v3f));
+  if (randomPts == NULL || gridPts == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+  randomPoints(randomPts, NUM_QUERY_POINTS, lo, hi, opts.seed);
+  gridPoints(gridPts, lo, hi);
+
+  printf("%-22s %7s %6s %12s %12s %12s %12s %12s %12s\n",
+    "benchmark (ns/op)", "samples", "ops", "mean", "p50", "p90", "p99",
+    "min", "max");
+
+  benchQuery("findFloor/random", queryFloor, snapshots, randomPts);
+  benchQuery("findFloor/grid", queryFloor, snapshots, gridPts);
+  benchQuery("findCeil/random", queryCeil, snapshots, randomPts);
+  benchQuery("findCeil/grid", queryCeil, snapshots, gridPts);
+  benchQuery("findWallCols/random", queryWalls, snapshots, randomPts);
+  benchQuery("findWallCols/grid", queryWalls, snapshots, gridPts);
+  benchLoadModel(snapshots);
+  benchUpdateModel(snapshots);
+  benchHeightMaps(snapshots, opts.sweepStride);
+  benchSearch("findPedroSpots", findPedroSpots, snapshots, opts.sweepStride);
+  benchSearch("findVolatileSpots", findVolatileSpots, snapshots,
+    opts.sweepStride);
+
+  free(randomPts);
+  free(gridPts);
+  freeShipSnapshots(snapshots);
+
+  if (csvFile != NULL && fclose(csvFile) != 0) {
+    fprintf(stderr, "Failed to write %s\n", opts.csvPath);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,272 @@
+#include "surface.h"
+
+#include "simd.h"
+#include "stats.h"
+#include "util.h"
+
+
+// Batched version of findFloor. Consecutive points that land in the same
+// partition cell are tested together against each triangle in the cell's
+// floor lists, several points per instruction. The arithmetic is the same as
+// findTriFromListBelow (s32 edge functions with wrapping, f32 plane height in
+// the same operation order), so the results are identical to the scalar path.
+// Like findFloor, the compiled partitions are used when they are valid.
+// Points whose neighbors are in a different cell (or fine grid subcell) fall
+// back to findFloor.
+
+
+#if LANES > 1
+
+typedef struct {
+  vs32 x;
+  vs32 z;
+  vf32 xf;
+  vf32 yf;
+  vf32 zf;
+  f32 heights[LANES];
+} BatchPoints;
+
+
+// Returns the mask of lanes that are on the triangle and not too far below it,
+// with their heights in p->heights
+static inline u32 testTriBelowBatch(
+  BatchPoints *p,
+  s32 x1, s32 z1, s32 x2, s32 z2, s32 x3, s32 z3,
+  f32 nx, f32 ny, f32 nz, f32 oo,
+  u32 pending)
+{
+  vs32 e1 = vs32_sub(
+    vs32_mul(vs32_sub(vs32_set1(z1), p->z), vs32_set1(x2 - x1)),
+    vs32_mul(vs32_sub(vs32_set1(x1), p->x), vs32_set1(z2 - z1)));
+  vs32 e2 = vs32_sub(
+    vs32_mul(vs32_sub(vs32_set1(z2), p->z), vs32_set1(x3 - x2)),
+    vs32_mul(vs32_sub(vs32_set1(x2), p->x), vs32_set1(z3 - z2)));
+  vs32 e3 = vs32_sub(
+    vs32_mul(vs32_sub(vs32_set1(z3), p->z), vs32_set1(x1 - x3)),
+    vs32_mul(vs32_sub(vs32_set1(x3), p->x), vs32_set1(z1 - z3)));
+
+  u32 outside = (u32) vs32_mask(
+    vs32_or(vs32_or(vs32_lt0(e1), vs32_lt0(e2)), vs32_lt0(e3)));
+  u32 candidates = pending & ~outside;
+
+  STAT_ADD(STAT_TRIS, __builtin_popcount(pending));
+  STAT_ADD(STAT_BATCH_EDGE_REJECTS, __builtin_popcount(pending & outside));
+  if (candidates == 0) return 0;
+
+  if (ny == 0.0f) {
+    STAT_ADD(STAT_HEIGHT_REJECTS, __builtin_popcount(candidates));
+    return 0;
+  }
+
+  vf32 height = vf32_div(
+    vf32_neg(vf32_add(
+      vf32_add(
+        vf32_mul(p->xf, vf32_set1(nx)),
+        vf32_mul(vf32_set1(nz), p->zf)),
+      vf32_set1(oo))),
+    vf32_set1(ny));
+
+  u32 below = (u32) vf32_lt0_mask(
+    vf32_sub(p->yf, vf32_add(height, vf32_set1(-78.0f))));
+  u32 found = candidates & ~below;
+  STAT_ADD(STAT_HEIGHT_REJECTS, __builtin_popcount(candidates & below));
+  if (found != 0)
+    vf32_store(p->heights, height);
+  return found;
+}
+
+
+static void storeFound(
+  BatchPoints *p,
+  u32 found,
+  Surface *tri,
+  s32 numPoints,
+  f32 *pheights,
+  Surface **ptris)
+{
+  for (s32 i = 0; i < numPoints; i++) {
+    if (found & (1u << i)) {
+      pheights[i] = p->heights[i];
+      ptris[i] = tri;
+    }
+  }
+}
+
+
+// Same as findTriFromListBelow, for up to LANES points at once. Lanes past
+// numPoints are padding and never resolve.
+static void findTrisFromListBelowBatch(
+  SurfaceNode *triangles,
+  BatchPoints *p,
+  s32 numPoints,
+  f32 *pheights,
+  Surface **ptris)
+{
+  u32 pending = (1u << numPoints) - 1;
+
+  while (triangles != NULL && pending != 0) {
+    Surface *tri = triangles->head;
+    triangles = triangles->tail;
+
+    u32 found = testTriBelowBatch(p,
+      tri->vertex1.x, tri->vertex1.z,
+      tri->vertex2.x, tri->vertex2.z,
+      tri->vertex3.x, tri->vertex3.z,
+      tri->normal.x, tri->normal.y, tri->normal.z, tri->originOffset,
+      pending);
+
+    if (found != 0) {
+      storeFound(p, found, tri, numPoints, pheights, ptris);
+      pending &= ~found;
+    }
+  }
+}
+
+
+// Same as findTriFromCompiledBelow, for up to LANES points at once
+static void findTrisFromCompiledBelowBatch(
+  CompiledPartitions *c,
+  CompiledList *list,
+  BatchPoints *p,
+  s32 numPoints,
+  f32 *pheights,
+  Surface **ptris)
+{
+  u32 pending = (1u << numPoints) - 1;
+
+  s32 end = list->start + list->count;
+  for (s32 i = list->start; i < end && pending != 0; i++) {
+    u32 found = testTriBelowBatch(p,
+      c->x1[i], c->z1[i], c->x2[i], c->z2[i], c->x3[i], c->z3[i],
+      c->nx[i], c->ny[i], c->nz[i], c->originOffset[i],
+      pending);
+
+    if (found != 0) {
+      storeFound(p, found, c->surfaces[i], numPoints, pheights, ptris);
+      pending &= ~found;
+    }
+  }
+}
+
+#endif
+
+
+void worldFindFloorBatch(
+  CollisionWorld *world,
+  const v3f *pts,
+  s32 n,
+  f32 *heights,
+  Surface **floors)
+{
+#if LANES > 1
+  s32 i = 0;
+  while (i < n) {
+    s32 xs[LANES] = {0};
+    s32 ys[LANES] = {0};
+    s32 zs[LANES] = {0};
+    u32 cellIdx = 0;
+    u32 key = 0;
+    s32 count = 0;
+
+    // With a fine grid, points are grouped by subcell instead, so that they
+    // all walk the same lists
+    CompiledPartitions *c = &world->compiled;
+    bool bySubcell = c->valid && c->fineGrid;
+
+    // Gather a run of in-bounds points that share a partition cell
+    while (i + count < n && count < LANES) {
+      s16 x = (s16) pts[i + count].x;
+      s16 y = (s16) pts[i + count].y;
+      s16 z = (s16) pts[i + count].z;
+
+      if (x <= -0x2000 || x >= 0x2000) break;
+      if (z <= -0x2000 || z >= 0x2000) break;
+
+      u32 xidx = ((x + 0x2000) / 0x400) & 0xF;
+      u32 zidx = ((z + 0x2000) / 0x400) & 0xF;
+      u32 pointKey = 16 * zidx + xidx;
+      if (bySubcell) {
+        u32 sx = ((x + 0x2000) & 0x3FF) / FINE_GRID_SIZE;
+        u32 sz = ((z + 0x2000) & 0x3FF) / FINE_GRID_SIZE;
+        pointKey = (pointKey * FINE_GRID_DIV + sz) * FINE_GRID_DIV + sx;
+      }
+
+      if (count == 0) {
+        cellIdx = 16 * zidx + xidx;
+        key = pointKey;
+      }
+      else if (pointKey != key) {
+        break;
+      }
+
+      xs[count] = x;
+      ys[count] = y;
+      zs[count] = z;
+      count += 1;
+    }
+
+    if (count < 2) {
+      heights[i] = worldFindFloor(world, pts[i], &floors[i]);
+      i += 1;
+      continue;
+    }
+
+    f32 dynHeights[LANES];
+    Surface *dynFloors[LANES];
+    for (s32 j = 0; j < count; j++) {
+      dynHeights[j] = -11000.0f;
+      dynFloors[j] = NULL;
+      heights[i + j] = -11000.0f;
+      floors[i + j] = NULL;
+    }
+
+    BatchPoints p;
+    p.x = vs32_load(xs);
+    p.z = vs32_load(zs);
+    p.xf = vs32_to_f32(p.x);
+    p.yf = vs32_to_f32(vs32_load(ys));
+    p.zf = vs32_to_f32(p.z);
+
+    if (c->valid) {
+      s16 x = (s16) xs[0];
+      s16 z = (s16) zs[0];
+      findTrisFromCompiledBelowBatch(c,
+        getCompiledList(c, true, cellIdx, 0, x, z),
+        &p, count, dynHeights, dynFloors);
+      STAT_TAKE(STAT_FLOOR_DYNAMIC_TRIS, STAT_TRIS);
+      findTrisFromCompiledBelowBatch(c,
+        getCompiledList(c, false, cellIdx, 0, x, z),
+        &p, count, &heights[i], &floors[i]);
+      STAT_TAKE(STAT_FLOOR_STATIC_TRIS, STAT_TRIS);
+    }
+    else {
+      findTrisFromListBelowBatch(world->dynamicPartition[cellIdx].floors,
+        &p, count, dynHeights, dynFloors);
+      STAT_TAKE(STAT_FLOOR_DYNAMIC_TRIS, STAT_TRIS);
+      findTrisFromListBelowBatch(world->staticPartition[cellIdx].floors,
+        &p, count, &heights[i], &floors[i]);
+      STAT_TAKE(STAT_FLOOR_STATIC_TRIS, STAT_TRIS);
+    }
+
+    STAT_ADD(STAT_FLOOR_QUERIES, count);
+    for (s32 j = 0; j < count; j++) {
+      if (dynHeights[j] > heights[i + j]) {
+        floors[i + j] = dynFloors[j];
+        heights[i + j] = dynHeights[j];
+      }
+      if (floors[i + j] == NULL)
+        STAT_INC(STAT_FLOOR_MISSES);
+    }
+
+    i += count;
+  }
+#else
+  for (s32 i = 0; i < n; i++)
+    heights[i] = worldFindFloor(world, pts[i], &floors[i]);
+#endif
+}
+
+
+void findFloorBatch(const v3f *pts, s32 n, f32 *heights, Surface **floors) {
+  worldFindFloorBatch(&defaultWorld, pts, n, heights, floors);
+}
@@ -0,0 +1,239 @@
+#include "heightmap.h"
+
+#include "stats.h"
+#include "surface.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define HEIGHT_MAP_BLOCK_SIZE 0x100000
+
+
+void initHeightMapStore(HeightMapStore *store) {
+  store->world = NULL;
+  store->maps = NULL;
+  store->rasterized = NULL;
+  store->capacity = 0;
+  store->blocks = NULL;
+  store->current = NULL;
+}
+
+
+void freeHeightMapStore(HeightMapStore *store) {
+  HeightMapBlock *block = store->blocks;
+  while (block != NULL) {
+    HeightMapBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+
+  free(store->maps);
+  free(store->rasterized);
+  initHeightMapStore(store);
+}
+
+
+void resetHeightMapStore(HeightMapStore *store, CollisionWorld *world) {
+  s32 numSurfaces = world->surfacesAllocated;
+
+  if (numSurfaces > store->capacity) {
+    free(store->maps);
+    free(store->rasterized);
+    store->maps = (SurfaceHeightMap *)
+      malloc(numSurfaces * sizeof(SurfaceHeightMap));
+    store->rasterized = (bool *) malloc(numSurfaces * sizeof(bool));
+    if (store->maps == NULL || store->rasterized == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+    store->capacity = numSurfaces;
+  }
+
+  for (s32 i = 0; i < numSurfaces; i++)
+    store->rasterized[i] = false;
+
+  for (HeightMapBlock *b = store->blocks; b != NULL; b = b->next)
+    b->used = 0;
+  store->current = store->blocks;
+  store->world = world;
+}
+
+
+static f32 *allocHeights(HeightMapStore *store, size_t count) {
+  HeightMapBlock *block = store->current;
+  HeightMapBlock *last = NULL;
+
+  while (block != NULL && block->capacity - block->used < count) {
+    last = block;
+    block = block->next;
+  }
+
+  if (block == NULL) {
+    size_t capacity = count > HEIGHT_MAP_BLOCK_SIZE
+      ? count
+      : HEIGHT_MAP_BLOCK_SIZE;
+    block = (HeightMapBlock *)
+      malloc(sizeof(HeightMapBlock) + capacity * sizeof(f32));
+    if (block == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+    block->next = NULL;
+    block->capacity = capacity;
+    block->used = 0;
+
+    // current is only NULL when there are no blocks yet
+    if (last != NULL)
+      last->next = block;
+    else
+      store->blocks = block;
+  }
+
+  store->current = block;
+  f32 *heights = &block->data[block->used];
+  block->used += count;
+  return heights;
+}
+
+
+// Tests every point in the bounding box with getFloorHeight or getCeilHeight
+static void rasterizePointwise(SurfaceHeightMap *m, Surface *s, char classif) {
+  for (s32 x = m->x0; x <= m->x1; x++) {
+    for (s32 z = m->z0; z <= m->z1; z++) {
+      bool onSurface;
+
+      if (classif == 'f')
+        onSurface = getFloorHeight(s, x, z, &map_get(m, x, z));
+      else
+        onSurface = getCeilHeight(s, x, z, &map_get(m, x, z));
+
+      if (!onSurface)
+        map_get(m, x, z) = map_none;
+    }
+  }
+}
+
+
+// Rounds towards negative infinity, for b > 0
+static s64 floorDiv(s64 a, s64 b) {
+  s64 q = a / b;
+  if (a % b != 0 && a < 0) q -= 1;
+  return q;
+}
+
+
+// Narrows [*lo, *hi] to the x where c + k*x >= 0
+static void clipSpan(s64 c, s64 k, s64 *lo, s64 *hi) {
+  if (k > 0) {
+    s64 x = -floorDiv(c, k);
+    if (x > *lo) *lo = x;
+  }
+  else if (k < 0) {
+    s64 x = floorDiv(c, -k);
+    if (x < *hi) *hi = x;
+  }
+  else if (c < 0) {
+    *hi = *lo - 1;
+  }
+}
+
+
+// For each row, solves for the x span where the three edge functions pass
+// the getFloorHeight (or getCeilHeight) test, and only evaluates the height
+// inside it. The edge functions are linear in x, and are computed in s64 so
+// the span is exact. They agree with the wrapping s32 versions as long as
+// those don't overflow, which the caller checks.
+//
+// The height is the same expression as getFloorHeight, with the row's z term
+// hoisted, so the results match bit for bit. Stepping the x term by adding
+// nx would accumulate rounding error, so it is still a multiply per point.
+static void rasterizeScanlines(SurfaceHeightMap *m, Surface *s, char classif) {
+  s32 xs[3] = { s->vertex1.x, s->vertex2.x, s->vertex3.x };
+  s32 zs[3] = { s->vertex1.z, s->vertex2.z, s->vertex3.z };
+  s64 sign = classif == 'f' ? 1 : -1;
+
+  f32 nx = s->normal.x;
+  f32 ny = s->normal.y;
+  f32 nz = s->normal.z;
+  f32 oo = s->originOffset;
+
+  for (s32 z = m->z0; z <= m->z1; z++) {
+    f32 *row = &map_get(m, m->x0, z);
+    s64 lo = m->x0;
+    s64 hi = ny == 0.0f ? lo - 1 : m->x1;
+
+    for (s32 i = 0; i < 3 && lo <= hi; i++) {
+      s32 j = (i + 1) % 3;
+      s64 dx = xs[j] - xs[i];
+      s64 dz = zs[j] - zs[i];
+      s64 c = (zs[i] - z) * dx - xs[i] * dz;
+      clipSpan(sign * c, sign * dz, &lo, &hi);
+    }
+
+    if (lo > hi) {
+      lo = m->x1 + 1;
+      hi = m->x1;
+    }
+
+    for (s32 x = m->x0; x < lo; x++)
+      row[x - m->x0] = map_none;
+
+    f32 nzz = nz * z;
+    for (s32 x = (s32) lo; x <= hi; x++)
+      row[x - m->x0] = -(x * nx + nzz + oo) / ny;
+
+    for (s32 x = (s32) hi + 1; x <= m->x1; x++)
+      row[x - m->x0] = map_none;
+  }
+}
+
+
+static void initSurfaceHeightMap(
+  HeightMapStore *store, SurfaceHeightMap *m, Surface *s)
+{
+  char classif = classifySurface(s);
+  if (classif == 'w') {
+    m->x0 = 0;
+    m->x1 = -1;
+    m->z0 = 0;
+    m->z1 = -1;
+    m->y = NULL;
+    return;
+  }
+
+  m->x0 = min3(s->vertex1.x, s->vertex2.x, s->vertex3.x) - 3;
+  m->x1 = max3(s->vertex1.x, s->vertex2.x, s->vertex3.x) + 3;
+  m->z0 = min3(s->vertex1.z, s->vertex2.z, s->vertex3.z) - 3;
+  m->z1 = max3(s->vertex1.z, s->vertex2.z, s->vertex3.z) + 3;
+
+  s64 width = m->x1 - m->x0;
+  s64 height = m->z1 - m->z0;
+
+  m->y = allocHeights(store, (size_t) (width + 1) * (height + 1));
+
+  // Each edge function term is bounded by width * height
+  if (width * height < 0x40000000)
+    rasterizeScanlines(m, s, classif);
+  else
+    rasterizePointwise(m, s, classif);
+}
+
+
+// Height map of surface i of the store's world
+SurfaceHeightMap *getSurfaceHeightMap(HeightMapStore *store, s32 i) {
+  SurfaceHeightMap *m = &store->maps[i];
+
+  if (!store->rasterized[i]) {
+    STAT_TIMER_START(STAT_TIME_HEIGHT_MAPS);
+    initSurfaceHeightMap(store, m, worldSurface(store->world, i));
+    STAT_TIMER_STOP(STAT_TIME_HEIGHT_MAPS);
+
+    STAT_INC(STAT_HEIGHT_MAPS);
+    STAT_ADD(STAT_HEIGHT_MAP_POINTS, (m->x1 - m->x0 + 1) * (m->z1 - m->z0 + 1));
+    store->rasterized[i] = true;
+  }
+
+  return m;
+}
@@ -0,0 +1,54 @@
+#ifndef HEIGHTMAP_H
+#define HEIGHTMAP_H
+
+
+#include "surface.h"
+#include "util.h"
+
+#include <stddef.h>
+
+
+// The floor or ceiling height of a surface at every integer (x, z) in its
+// bounding box, padded by 3 units. Points off the surface hold map_none.
+typedef struct {
+  s16 x0;
+  s16 z0;
+  s16 x1;
+  s16 z1;
+  f32 *y;
+} SurfaceHeightMap;
+
+#define map_get(m, x, z) m->y[(m->x1 - m->x0 + 1) * ((z) - m->z0) + (x) - m->x0]
+#define map_none -12000.0f
+
+
+typedef struct HeightMapBlock {
+  struct HeightMapBlock *next;
+  size_t capacity;
+  size_t used;
+  f32 data[];
+} HeightMapBlock;
+
+
+// Height maps for the surfaces of one world, rasterized the first time they
+// are requested. The grids are carved out of a list of large blocks that are
+// kept when the store is reset, so a store can be reused for each index
+// without going back to the allocator. A store is not thread safe; each
+// search thread should have its own.
+typedef struct {
+  CollisionWorld *world;
+  SurfaceHeightMap *maps;
+  bool *rasterized;
+  s32 capacity;
+  HeightMapBlock *blocks;
+  HeightMapBlock *current;
+} HeightMapStore;
+
+
+void initHeightMapStore(HeightMapStore *store);
+void freeHeightMapStore(HeightMapStore *store);
+void resetHeightMapStore(HeightMapStore *store, CollisionWorld *world);
+SurfaceHeightMap *getSurfaceHeightMap(HeightMapStore *store, s32 i);
+
+
+#endif
@@ -0,0 +1,149 @@
+#include "level.h"
+
+#include "surface.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+static s16 *readBigEndianS16s(const char *path, s32 *length) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return NULL;
+  }
+
+  long size = -1;
+  if (fseek(f, 0, SEEK_END) == 0)
+    size = ftell(f);
+  if (size < 0 || fseek(f, 0, SEEK_SET) != 0) {
+    fprintf(stderr, "Failed to read %s\n", path);
+    fclose(f);
+    return NULL;
+  }
+  if (size % 2 != 0 || size / 2 > 0x7FFFFFFF) {
+    fprintf(stderr, "%s: not a sequence of s16 values\n", path);
+    fclose(f);
+    return NULL;
+  }
+
+  u8 *bytes = (u8 *) malloc(size > 0 ? size : 1);
+  if (bytes == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  if (fread(bytes, 1, size, f) != (size_t) size) {
+    fprintf(stderr, "Failed to read %s\n", path);
+    free(bytes);
+    fclose(f);
+    return NULL;
+  }
+  fclose(f);
+
+  // Converted in place, reading each pair before it is overwritten
+  s16 *values = (s16 *) bytes;
+  for (long i = 0; i < size / 2; i++)
+    values[i] = (s16) (bytes[2 * i] << 8 | bytes[2 * i + 1]);
+
+  *length = (s32) (size / 2);
+  return values;
+}
+
+
+// Checks that worldLoadStaticSurfaces stays within the data and the vertex
+// lists
+static bool validateLevel(const char *path, s16 *data, s32 length) {
+  s32 pos = 0;
+  s32 numVerts = -1;
+
+  while (true) {
+    if (pos >= length) {
+      fprintf(stderr, "%s: missing end of collision (0x42)\n", path);
+      return false;
+    }
+    s32 commandPos = pos;
+    s16 command = data[pos++];
+
+    if (command == 0x40) {
+      if (pos >= length || data[pos] < 0 ||
+        3 * data[pos] > length - pos - 1)
+      {
+        fprintf(stderr, "%s: bad vertex list at %d\n", path, commandPos);
+        return false;
+      }
+      numVerts = data[pos];
+      if (numVerts > MAX_COLLISION_VERTICES) {
+        fprintf(stderr, "%s: %d vertices at %d, at most %d are supported\n",
+          path, numVerts, commandPos, MAX_COLLISION_VERTICES);
+        return false;
+      }
+      pos += 1 + 3 * numVerts;
+    }
+    else if (command == 0x41) {
+      continue;
+    }
+    else if (command >= 0x42 && command <= 0x44) {
+      break;
+    }
+    else if (command >= 0 && (command < 0x40 || command >= 0x65)) {
+      s32 stride = surfaceHasForce(command) ? 4 : 3;
+      if (numVerts < 0 || pos >= length || data[pos] < 0 ||
+        stride * data[pos] > length - pos - 1)
+      {
+        fprintf(stderr, "%s: bad surface list at %d\n", path, commandPos);
+        return false;
+      }
+      s32 numTris = data[pos++];
+
+      for (s32 i = 0; i < numTris; i++, pos += stride) {
+        for (s32 j = 0; j < 3; j++) {
+          if (data[pos + j] < 0 || data[pos + j] >= numVerts) {
+            fprintf(stderr, "%s: bad vertex index at %d\n", path, pos + j);
+            return false;
+          }
+        }
+      }
+    }
+    else {
+      fprintf(stderr, "%s: unknown command 0x%X at %d\n",
+        path, (u16) command, commandPos);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+LevelCollision *loadLevelCollision(const char *path) {
+  s32 length;
+  s16 *data = readBigEndianS16s(path, &length);
+  if (data == NULL) return NULL;
+
+  if (!validateLevel(path, data, length)) {
+    free(data);
+    return NULL;
+  }
+
+  LevelCollision *level = (LevelCollision *) malloc(sizeof(LevelCollision));
+  CollisionWorld *world = newCollisionWorld();
+  if (level == NULL || world == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  worldLoadStaticSurfaces(world, data);
+
+  level->data = data;
+  level->length = length;
+  level->world = world;
+  return level;
+}
+
+
+void freeLevelCollision(LevelCollision *level) {
+  freeCollisionWorld(level->world);
+  free(level->data);
+  free(level);
+}
@@ -0,0 +1,32 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+
+#include "surface.h"
+#include "util.h"
+
+
+// Static level collision, read from a file holding a level collision stream
+// as it appears in the ROM: big-endian s16 values, starting with a vertex
+// list (0x40) and ending with 0x42 (or the special object / environment
+// region lists, which aren't loaded). jrb-ship-model is an object model in
+// the same encoding.
+//
+// The file is read, validated and loaded into a world of its own once.
+// Worlds that need the level copy its static surfaces from there with
+// worldCopyStaticSurfaces, which is much cheaper than reloading.
+
+typedef struct {
+  s16 *data;
+  s32 length;
+  CollisionWorld *world;
+} LevelCollision;
+
+
+// Returns NULL and prints the reason if the file can't be read or is
+// malformed
+LevelCollision *loadLevelCollision(const char *path);
+void freeLevelCollision(LevelCollision *level);
+
+
+#endif
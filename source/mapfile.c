@@ -0,0 +1,69 @@
+#include "mapfile.h"
+
+#include "util.h"
+
+#include <stddef.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+void *mapFile(const char *path, size_t *psize, bool writable) {
+#ifdef WIN32
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) return NULL;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    CloseHandle(file);
+    return NULL;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, NULL,
+    writable ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(file);
+  if (mapping == NULL) return NULL;
+
+  void *data = MapViewOfFile(mapping,
+    writable ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (data == NULL) return NULL;
+
+  *psize = (size_t) size.QuadPart;
+  return data;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+
+  int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+  void *data = mmap(NULL, st.st_size, prot, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return NULL;
+
+  *psize = st.st_size;
+  return data;
+#endif
+}
+
+
+void unmapFile(void *data, size_t size) {
+#ifdef WIN32
+  (void) size;
+  UnmapViewOfFile(data);
+#else
+  munmap(data, size);
+#endif
+}
@@ -0,0 +1,17 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+
+#include "util.h"
+
+#include <stddef.h>
+
+
+// Maps a whole file into memory. Returns NULL if it can't be opened or is
+// empty. A writable mapping is private copy-on-write: writes only touch this
+// process's copy of the pages they land on, never the file.
+void *mapFile(const char *path, size_t *psize, bool writable);
+void unmapFile(void *data, size_t size);
+
+
+#endif
@@ -0,0 +1,115 @@
+#include "model.h"
+
+#include "mapfile.h"
+#include "surface.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+static s16 swapS16(s16 v) {
+  u16 u = (u16) v;
+  return (s16) (u << 8 | u >> 8);
+}
+
+
+// Checks that loadObjectCollisionModel stays within the data and the vertex
+// list
+static bool validateModel(
+  const char *path, s16 *data, s32 length, CollisionModelFile *file)
+{
+  if (length < 2 || data[0] != 0x40) {
+    fprintf(stderr, "%s: not a collision model (no leading 0x40)\n", path);
+    return false;
+  }
+
+  s32 numVerts = data[1];
+  if (numVerts < 0 || 3 * numVerts > length - 2) {
+    fprintf(stderr, "%s: bad vertex list\n", path);
+    return false;
+  }
+  if (numVerts > MAX_COLLISION_VERTICES) {
+    fprintf(stderr, "%s: %d vertices, at most %d are supported\n",
+      path, numVerts, MAX_COLLISION_VERTICES);
+    return false;
+  }
+
+  s32 pos = 2 + 3 * numVerts;
+  s32 numTris = 0;
+
+  while (true) {
+    if (pos >= length) {
+      fprintf(stderr, "%s: missing end of model (0x41)\n", path);
+      return false;
+    }
+    if (data[pos] == 0x41) break;
+
+    s32 groupPos = pos;
+    s16 surfaceType = data[pos++];
+    s32 stride = surfaceHasForce(surfaceType) ? 4 : 3;
+    if (pos >= length || data[pos] < 0 ||
+      stride * data[pos] > length - pos - 1)
+    {
+      fprintf(stderr, "%s: bad surface group at %d\n", path, groupPos);
+      return false;
+    }
+    s32 groupTris = data[pos++];
+
+    for (s32 i = 0; i < groupTris; i++, pos += stride) {
+      for (s32 j = 0; j < 3; j++) {
+        if (data[pos + j] < 0 || data[pos + j] >= numVerts) {
+          fprintf(stderr, "%s: bad vertex index at %d\n", path, pos + j);
+          return false;
+        }
+      }
+    }
+    numTris += groupTris;
+  }
+
+  file->numVertices = numVerts;
+  file->numTris = numTris;
+  return true;
+}
+
+
+bool mapCollisionModel(CollisionModelFile *file, const char *path) {
+  memset(file, 0, sizeof(CollisionModelFile));
+
+  size_t size;
+  void *data = mapFile(path, &size, true);
+  if (data == NULL) {
+    fprintf(stderr, "Failed to map %s\n", path);
+    return false;
+  }
+
+  s16 *model = (s16 *) data;
+  if (size % 2 != 0 || size / 2 > 0x7FFFFFFF) {
+    fprintf(stderr, "%s: not a sequence of s16 values\n", path);
+    unmapFile(data, size);
+    return false;
+  }
+  s32 length = (s32) (size / 2);
+
+  if (length > 0 && model[0] == swapS16(0x40)) {
+    for (s32 i = 0; i < length; i++)
+      model[i] = swapS16(model[i]);
+  }
+
+  if (!validateModel(path, model, length, file)) {
+    unmapFile(data, size);
+    return false;
+  }
+
+  file->data = data;
+  file->size = size;
+  file->model = model;
+  return true;
+}
+
+
+void unmapCollisionModel(CollisionModelFile *file) {
+  if (file->data != NULL)
+    unmapFile(file->data, file->size);
+  memset(file, 0, sizeof(CollisionModelFile));
+}
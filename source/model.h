@@ -0,0 +1,36 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+
+#include "util.h"
+
+#include <stddef.h>
+
+
+// Object collision models loaded from files, in the s16 format that
+// loadObjectCollisionModel reads: 0x40, a vertex list, surface groups, then
+// 0x41. Anything after the 0x41 is ignored. jrb-ship-model is an example.
+//
+// The file is memory mapped and model points into the mapping, so it can be
+// used as an Object's collisionModel directly. Files in native byte order
+// are used in place without copying. Files in the other order (such as data
+// taken from the big-endian ROM) are recognized by their leading 0x40 and
+// swapped in place. The mapping is private, so only the touched pages are
+// copied, and the file itself is never written.
+
+typedef struct {
+  void *data;
+  size_t size;
+  s16 *model;
+  s32 numVertices;
+  s32 numTris;
+} CollisionModelFile;
+
+
+// Returns false and prints the reason if the file can't be mapped or isn't a
+// valid model
+bool mapCollisionModel(CollisionModelFile *file, const char *path);
+void unmapCollisionModel(CollisionModelFile *file);
+
+
+#endif
@@ -3,6 +3,7 @@
 #include "util.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 
 /** 802C80F8(J) */
@@ -80,6 +81,7 @@ void applyPlatformDisplacement(v3f *p, v3h *marioFaceAngle, Object *plat) {
 
 
 static s16 jrbShipModel[];
+static const PlatformBehavior jrbShipAfloatBehavior;
 
 
 void initJrbShipAfloat(Object *o) {
@@ -87,6 +89,7 @@ void initJrbShipAfloat(Object *o) {
   o->pos = (v3f) { 4880, 820, 2375 };
   o->scale = (v3f) { 1, 1, 1 };
   o->collisionModel = &jrbShipModel;
+  o->behavior = &jrbShipAfloatBehavior;
 }
 
 
@@ -120,6 +123,65 @@ void updateJrbShipAfloatIndex(Object *curObj, s32 idx) {
 }
 
 
+// Sets v0F8 on the same grid of 0x100 steps that v0F4 takes. The roll is
+// recomputed from it on the next update.
+void setJrbShipAfloatRoll(Object *curObj, s32 phase) {
+  curObj->v0F8 = (phase & 0xFF) * 0x100;
+}
+
+
+// v0F4 advances by 0x100 a frame, so the pitch repeats every 0x100 frames.
+// v0F8 is never advanced, so the roll is fixed for the life of the ship.
+static const PlatformBehavior jrbShipAfloatBehavior = {
+  "jrb-ship-afloat",
+  0x100,
+  initJrbShipAfloat,
+  updateJrbShipAfloat,
+  updateJrbShipAfloatIndex,
+  0x100,
+  setJrbShipAfloatRoll,
+};
+
+
+const PlatformBehavior *const platformBehaviors[] = {
+  &jrbShipAfloatBehavior,
+};
+
+const s32 numPlatformBehaviors =
+  sizeof(platformBehaviors) / sizeof(platformBehaviors[0]);
+
+
+const PlatformBehavior *findPlatformBehavior(const char *name) {
+  for (s32 i = 0; i < numPlatformBehaviors; i++) {
+    if (strcmp(platformBehaviors[i]->name, name) == 0)
+      return platformBehaviors[i];
+  }
+  return NULL;
+}
+
+
+void initPlatform(Object *o, const PlatformBehavior *behavior) {
+  behavior->init(o);
+  o->behavior = behavior;
+}
+
+
+void updatePlatform(Object *o) {
+  o->behavior->update(o);
+}
+
+
+void setPlatformIndex(Object *o, s32 idx) {
+  o->behavior->setIndex(o, idx);
+}
+
+
+void setPlatformFixedPhase(Object *o, s32 phase) {
+  if (o->behavior->setFixedPhase != NULL)
+    o->behavior->setFixedPhase(o, phase);
+}
+
+
 static s16 jrbShipModel[] = {
   0x0040,0x004f,0xfd9b,0x02cd,0xffd0,0xfd34,0x0466,0xffa5,
   0xfd34,0x02cd,0xffd0,0x02cd,0x0466,0xffa5,0xfd9b,0x0466,
@@ -6,6 +6,7 @@
 
 
 typedef struct Object Object;
+typedef struct PlatformBehavior PlatformBehavior;
 
 
 struct Object {
@@ -19,15 +20,50 @@ struct Object {
 
   s32 v0F4;
   s32 v0F8;
+
+  const PlatformBehavior *behavior;
+};
+
+
+// A periodic moving platform. init places a new object in its home pose with
+// the default collision model. update steps it one frame, as the game's
+// behavior does. setIndex puts it at frame idx of its cycle (taken modulo
+// period), with platformRotation set as if it had been stepped there from
+// its previous pose.
+//
+// Some behaviors also read a phase that update never advances, such as the
+// ship's roll (v0F8). It stays at whatever the object was spawned with, so
+// each of its numFixedPhases values gives a separate cycle. setFixedPhase
+// selects one (taken modulo numFixedPhases); behaviors without a fixed phase
+// have numFixedPhases 1 and setFixedPhase NULL.
+struct PlatformBehavior {
+  const char *name;
+  s32 period;
+  void (*init)(Object *o);
+  void (*update)(Object *o);
+  void (*setIndex)(Object *o, s32 idx);
+  s32 numFixedPhases;
+  void (*setFixedPhase)(Object *o, s32 phase);
 };
 
 
+extern const PlatformBehavior *const platformBehaviors[];
+extern const s32 numPlatformBehaviors;
+
+const PlatformBehavior *findPlatformBehavior(const char *name);
+void initPlatform(Object *o, const PlatformBehavior *behavior);
+void updatePlatform(Object *o);
+void setPlatformIndex(Object *o, s32 idx);
+void setPlatformFixedPhase(Object *o, s32 phase);
+
+
 void applyPlatformDisplacement(v3f *p, v3h *marioFaceAngle, Object *plat);
 
 
 void initJrbShipAfloat(Object *o);
 void updateJrbShipAfloat(Object *curObj);
 void updateJrbShipAfloatIndex(Object *curObj, s32 idx);
+void setJrbShipAfloatRoll(Object *curObj, s32 phase);
 
 
 #endif
\ No newline at end of file
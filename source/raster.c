@@ -0,0 +1,838 @@
+#include "raster.h"
+
+#include "simd.h"
+#include "spots.h"
+#include "surface.h"
+#include "util.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define TILE_SIZE 32
+
+// Outlines cover the pixels within this distance of a triangle's edges
+#define OUTLINE_WIDTH 1.0f
+
+// Spots are drawn this far above their floor, so that they win the depth
+// test against it wherever it slopes up across the square
+#define SPOT_LIFT 1.0f
+
+
+static const u8 floorColor[3] = { 128, 128, 255 };
+static const u8 ceilColor[3] = { 255, 128, 128 };
+static const u8 wallColor[3] = { 77, 204, 77 };
+static const u8 outlineColor[3] = { 0, 0, 0 };
+static const u8 spotColor[3] = { 255, 255, 255 };
+
+
+typedef struct {
+  f32 x;
+  f32 y;
+  f32 z;
+  f32 w;
+} ClipVertex;
+
+
+// Screen space triangle. Edge i is a[i] * x + b[i] * y + c[i], positive on
+// the inside, and invLength[i] scales it to a distance in pixels.
+typedef struct {
+  f32 a[3];
+  f32 b[3];
+  f32 c[3];
+  f32 invLength[3];
+  f32 dzdx;
+  f32 dzdy;
+  f32 z0;
+  s32 x0;
+  s32 y0;
+  s32 x1;
+  s32 y1;
+  const u8 *color;
+} RasterTriangle;
+
+
+typedef struct {
+  s32 x0;
+  s32 y0;
+  s32 x1;
+  s32 y1;
+  f32 z;
+} RasterSpot;
+
+
+// Triangles and spots are binned by the tiles their bounds overlap. Tile
+// t's are triList[triOffsets[t], triOffsets[t + 1]), in drawing order.
+typedef struct {
+  Image *image;
+  RasterTriangle *tris;
+  s32 numTris;
+  s32 trisCapacity;
+  RasterSpot *spots;
+  s32 numSpots;
+  s32 tilesX;
+  s32 tilesY;
+  s32 *triOffsets;
+  s32 *triList;
+  s32 *spotOffsets;
+  s32 *spotList;
+  s32 nextTile;
+  pthread_mutex_t lock;
+} RasterJob;
+
+
+static void *allocOrDie(size_t size) {
+  void *p = malloc(size > 0 ? size : 1);
+  if (p == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  return p;
+}
+
+
+void initImage(Image *image, s32 width, s32 height) {
+  image->width = width;
+  image->height = height;
+  image->rgb = (u8 *) allocOrDie((size_t) width * height * 3);
+  image->depth = (f32 *) allocOrDie((size_t) width * height * sizeof(f32));
+}
+
+
+void freeImage(Image *image) {
+  free(image->rgb);
+  free(image->depth);
+  image->rgb = NULL;
+  image->depth = NULL;
+}
+
+
+static void multiplyMatrices(Mtxf dst, Mtxf a, Mtxf b) {
+  Mtxf m;
+  for (s32 i = 0; i < 4; i++) {
+    for (s32 j = 0; j < 4; j++) {
+      m[i][j] = 0;
+      for (s32 k = 0; k < 4; k++)
+        m[i][j] += a[i][k] * b[k][j];
+    }
+  }
+  memcpy(dst, m, sizeof(Mtxf));
+}
+
+
+void topDownView(Mtxf m, s32 width, s32 height, v3f lo, v3f hi) {
+  f32 scale = fminf(width / (hi.x - lo.x), height / (hi.z - lo.z));
+  f32 cx = (lo.x + hi.x) / 2;
+  f32 cy = (lo.y + hi.y) / 2;
+  f32 cz = (lo.z + hi.z) / 2;
+
+  memset(m, 0, sizeof(Mtxf));
+  m[0][0] = 2 * scale / width;
+  m[0][3] = -cx * m[0][0];
+  m[1][2] = -2 * scale / height;
+  m[1][3] = -cz * m[1][2];
+  m[2][1] = -2 / (hi.y - lo.y);
+  m[2][3] = -cy * m[2][1];
+  m[3][3] = 1;
+}
+
+
+// Same as the viewer's glFrustum(-1, 1, -1, 1, 2, 10000) and glRotatef calls
+void cameraView(Mtxf m, v3f pos, f32 pitch, f32 yaw) {
+  f32 n = 2;
+  f32 f = 10000;
+  Mtxf frustum = {
+    { n, 0, 0, 0 },
+    { 0, n, 0, 0 },
+    { 0, 0, -(f + n) / (f - n), -2 * f * n / (f - n) },
+    { 0, 0, -1, 0 },
+  };
+
+  f32 cp = cosf(-pitch);
+  f32 sp = sinf(-pitch);
+  Mtxf rotatePitch = {
+    { 1, 0, 0, 0 },
+    { 0, cp, -sp, 0 },
+    { 0, sp, cp, 0 },
+    { 0, 0, 0, 1 },
+  };
+
+  // The yaw rotation and the extra half turn about y
+  f32 cy = cosf(3.1415926f - yaw);
+  f32 sy = sinf(3.1415926f - yaw);
+  Mtxf rotateYaw = {
+    { cy, 0, sy, 0 },
+    { 0, 1, 0, 0 },
+    { -sy, 0, cy, 0 },
+    { 0, 0, 0, 1 },
+  };
+
+  Mtxf translate = {
+    { 1, 0, 0, -pos.x },
+    { 0, 1, 0, -pos.y },
+    { 0, 0, 1, -pos.z },
+    { 0, 0, 0, 1 },
+  };
+
+  multiplyMatrices(m, frustum, rotatePitch);
+  multiplyMatrices(m, m, rotateYaw);
+  multiplyMatrices(m, m, translate);
+}
+
+
+static ClipVertex transformPoint(Mtxf m, f32 x, f32 y, f32 z) {
+  ClipVertex v;
+  v.x = m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3];
+  v.y = m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3];
+  v.z = m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3];
+  v.w = m[3][0] * x + m[3][1] * y + m[3][2] * z + m[3][3];
+  return v;
+}
+
+
+static s32 clampInt(s32 v, s32 lo, s32 hi) {
+  return v < lo ? lo : v > hi ? hi : v;
+}
+
+
+// Screen x, y in pixels and depth, from a vertex in front of the near plane
+static void toScreen(const Image *image, const ClipVertex *v, f32 *s) {
+  s[0] = (v->x / v->w + 1) * 0.5f * image->width;
+  s[1] = (1 - v->y / v->w) * 0.5f * image->height;
+  s[2] = v->z / v->w;
+}
+
+
+static void addTriangle(
+  RasterJob *job, const ClipVertex *v0, const ClipVertex *v1,
+  const ClipVertex *v2, const u8 *color)
+{
+  f32 p[3][3];
+  toScreen(job->image, v0, p[0]);
+  toScreen(job->image, v1, p[1]);
+  toScreen(job->image, v2, p[2]);
+
+  f32 area = (p[1][0] - p[0][0]) * (p[2][1] - p[0][1]) -
+    (p[1][1] - p[0][1]) * (p[2][0] - p[0][0]);
+  if (!(fabsf(area) > 1e-6f)) return;
+  if (area < 0) {
+    for (s32 i = 0; i < 3; i++) {
+      f32 t = p[1][i];
+      p[1][i] = p[2][i];
+      p[2][i] = t;
+    }
+    area = -area;
+  }
+
+  f32 minX = fminf(p[0][0], fminf(p[1][0], p[2][0]));
+  f32 maxX = fmaxf(p[0][0], fmaxf(p[1][0], p[2][0]));
+  f32 minY = fminf(p[0][1], fminf(p[1][1], p[2][1]));
+  f32 maxY = fmaxf(p[0][1], fmaxf(p[1][1], p[2][1]));
+  Image *image = job->image;
+  if (maxX < 0 || maxY < 0 || minX >= image->width || minY >= image->height)
+    return;
+
+  if (job->numTris == job->trisCapacity) {
+    job->trisCapacity = job->trisCapacity > 0 ? 2 * job->trisCapacity : 256;
+    job->tris = (RasterTriangle *) realloc(job->tris,
+      job->trisCapacity * sizeof(RasterTriangle));
+    if (job->tris == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+  }
+  RasterTriangle *t = &job->tris[job->numTris++];
+
+  // Edge i runs from vertex i to vertex i + 1
+  for (s32 i = 0; i < 3; i++) {
+    const f32 *a = p[i];
+    const f32 *b = p[(i + 1) % 3];
+    t->a[i] = a[1] - b[1];
+    t->b[i] = b[0] - a[0];
+    t->c[i] = (b[1] - a[1]) * a[0] - (b[0] - a[0]) * a[1];
+    t->invLength[i] = 1 / sqrtf(t->a[i] * t->a[i] + t->b[i] * t->b[i]);
+  }
+
+  f32 dx1 = p[1][0] - p[0][0];
+  f32 dy1 = p[1][1] - p[0][1];
+  f32 dz1 = p[1][2] - p[0][2];
+  f32 dx2 = p[2][0] - p[0][0];
+  f32 dy2 = p[2][1] - p[0][1];
+  f32 dz2 = p[2][2] - p[0][2];
+  t->dzdx = (dz1 * dy2 - dy1 * dz2) / area;
+  t->dzdy = (dx1 * dz2 - dz1 * dx2) / area;
+  t->z0 = p[0][2] - t->dzdx * p[0][0] - t->dzdy * p[0][1];
+
+  t->x0 = clampInt((s32) floorf(minX), 0, image->width - 1);
+  t->x1 = clampInt((s32) ceilf(maxX), 0, image->width - 1);
+  t->y0 = clampInt((s32) floorf(minY), 0, image->height - 1);
+  t->y1 = clampInt((s32) ceilf(maxY), 0, image->height - 1);
+  t->color = color;
+}
+
+
+// Clips the triangle against the near plane (z >= -w) and adds what's left
+static void clipTriangle(RasterJob *job, const ClipVertex *v, const u8 *color)
+{
+  ClipVertex out[4];
+  s32 numOut = 0;
+
+  for (s32 i = 0; i < 3; i++) {
+    const ClipVertex *a = &v[i];
+    const ClipVertex *b = &v[(i + 1) % 3];
+    f32 da = a->z + a->w;
+    f32 db = b->z + b->w;
+
+    if (da >= 0)
+      out[numOut++] = *a;
+    if ((da >= 0) != (db >= 0)) {
+      f32 t = da / (da - db);
+      ClipVertex *c = &out[numOut++];
+      c->x = a->x + t * (b->x - a->x);
+      c->y = a->y + t * (b->y - a->y);
+      c->z = a->z + t * (b->z - a->z);
+      c->w = a->w + t * (b->w - a->w);
+    }
+  }
+
+  for (s32 i = 2; i < numOut; i++)
+    addTriangle(job, &out[0], &out[i - 1], &out[i], color);
+}
+
+
+static void addSurfaces(RasterJob *job, Mtxf view, CollisionWorld *world) {
+  for (s32 i = 0; i < world->surfacesAllocated; i++) {
+    Surface *s = worldSurface(world, i);
+
+    const u8 *color = wallColor;
+    switch (classifySurface(s)) {
+    case 'f': color = floorColor; break;
+    case 'c': color = ceilColor; break;
+    }
+
+    ClipVertex v[3] = {
+      transformPoint(view, s->vertex1.x, s->vertex1.y, s->vertex1.z),
+      transformPoint(view, s->vertex2.x, s->vertex2.y, s->vertex2.z),
+      transformPoint(view, s->vertex3.x, s->vertex3.y, s->vertex3.z),
+    };
+    clipTriangle(job, v, color);
+  }
+}
+
+
+// Spots cover the pixels whose centers fall in their square, and at least
+// one, so that they stay visible when zoomed out
+static void addSpots(
+  RasterJob *job, Mtxf view, const Spot *spots, s32 numSpots, bool onTop)
+{
+  Image *image = job->image;
+  job->spots = (RasterSpot *) allocOrDie(numSpots * sizeof(RasterSpot));
+  job->numSpots = 0;
+
+  for (s32 i = 0; i < numSpots; i++) {
+    const Spot *s = &spots[i];
+    f32 minX = 1e30f, maxX = -1e30f, minY = 1e30f, maxY = -1e30f;
+    f32 minZ = 1e30f;
+    bool visible = true;
+
+    for (s32 k = 0; k < 4; k++) {
+      ClipVertex v = transformPoint(view,
+        s->x + (k & 1) * SPOT_DRAW_SIZE, s->y + SPOT_LIFT,
+        s->z + (k >> 1) * SPOT_DRAW_SIZE);
+      if (v.z < -v.w) {
+        visible = false;
+        break;
+      }
+
+      f32 p[3];
+      toScreen(image, &v, p);
+      minX = fminf(minX, p[0]);
+      maxX = fmaxf(maxX, p[0]);
+      minY = fminf(minY, p[1]);
+      maxY = fmaxf(maxY, p[1]);
+      minZ = fminf(minZ, p[2]);
+    }
+    if (!visible || maxX < 0 || maxY < 0 ||
+      minX >= image->width || minY >= image->height)
+    {
+      continue;
+    }
+
+    RasterSpot *r = &job->spots[job->numSpots++];
+    r->x0 = (s32) floorf(minX + 0.5f);
+    r->x1 = (s32) ceilf(maxX - 0.5f) - 1;
+    r->y0 = (s32) floorf(minY + 0.5f);
+    r->y1 = (s32) ceilf(maxY - 0.5f) - 1;
+    if (r->x1 < r->x0) r->x1 = r->x0 = (s32) floorf((minX + maxX) / 2);
+    if (r->y1 < r->y0) r->y1 = r->y0 = (s32) floorf((minY + maxY) / 2);
+    r->x0 = clampInt(r->x0, 0, image->width - 1);
+    r->x1 = clampInt(r->x1, 0, image->width - 1);
+    r->y0 = clampInt(r->y0, 0, image->height - 1);
+    r->y1 = clampInt(r->y1, 0, image->height - 1);
+    r->z = onTop ? -INFINITY : minZ;
+  }
+}
+
+
+// Bins items with the given pixel bounds (x0, y0, x1, y1 at stride ints
+// apart) into the tiles they overlap
+static void binItems(
+  RasterJob *job, const s32 *bounds, size_t stride, s32 count,
+  s32 **offsets, s32 **list)
+{
+  s32 numTiles = job->tilesX * job->tilesY;
+  s32 *o = (s32 *) calloc(numTiles + 1, sizeof(s32));
+  if (o == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  for (s32 pass = 0; pass < 2; pass++) {
+    s32 total = 0;
+    s32 *l = pass == 1 ? *list : NULL;
+
+    for (s32 i = 0; i < count; i++) {
+      const s32 *b = bounds + i * stride;
+      for (s32 ty = b[1] / TILE_SIZE; ty <= b[3] / TILE_SIZE; ty++) {
+        for (s32 tx = b[0] / TILE_SIZE; tx <= b[2] / TILE_SIZE; tx++) {
+          s32 tile = ty * job->tilesX + tx;
+          if (pass == 0)
+            o[tile + 1] += 1;
+          else
+            l[o[tile]++] = i;
+          total += 1;
+        }
+      }
+    }
+
+    if (pass == 0) {
+      for (s32 t = 0; t < numTiles; t++)
+        o[t + 1] += o[t];
+      *list = (s32 *) allocOrDie(total * sizeof(s32));
+    }
+    else {
+      // Filling advanced each offset to the next tile's start
+      memmove(o + 1, o, numTiles * sizeof(s32));
+      o[0] = 0;
+    }
+  }
+
+  *offsets = o;
+}
+
+
+static inline void plotPixel(Image *image, s32 i, f32 z, const u8 *color) {
+  if (!(z <= image->depth[i])) return;
+  image->depth[i] = z;
+  memcpy(&image->rgb[3 * i], color, 3);
+}
+
+
+static void rasterizeTriangle(
+  Image *image, const RasterTriangle *t, s32 tx0, s32 ty0, s32 tx1, s32 ty1)
+{
+  s32 x0 = t->x0 > tx0 ? t->x0 : tx0;
+  s32 x1 = t->x1 < tx1 ? t->x1 : tx1;
+  s32 y0 = t->y0 > ty0 ? t->y0 : ty0;
+  s32 y1 = t->y1 < ty1 ? t->y1 : ty1;
+
+#if LANES > 1
+  static const f32 laneOffsets[8] = {
+    0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f };
+  vf32 offsets = vf32_load(laneOffsets);
+  vf32 a[3], scale[3];
+  for (s32 i = 0; i < 3; i++) {
+    a[i] = vf32_set1(t->a[i]);
+    scale[i] = vf32_set1(t->invLength[i]);
+  }
+  vf32 dzdx = vf32_set1(t->dzdx);
+  vf32 outline = vf32_set1(OUTLINE_WIDTH);
+#endif
+
+  for (s32 y = y0; y <= y1; y++) {
+    f32 fy = y + 0.5f;
+    f32 rowE[3];
+    for (s32 i = 0; i < 3; i++)
+      rowE[i] = t->b[i] * fy + t->c[i];
+    f32 rowZ = t->dzdy * fy + t->z0;
+    s32 row = y * image->width;
+
+#if LANES > 1
+    vf32 rowEv[3];
+    for (s32 i = 0; i < 3; i++)
+      rowEv[i] = vf32_set1(rowE[i]);
+    vf32 rowZv = vf32_set1(rowZ);
+
+    for (s32 x = x0; x <= x1; x += LANES) {
+      vf32 fx = vf32_add(vf32_set1((f32) x), offsets);
+      vf32 e[3];
+      for (s32 i = 0; i < 3; i++)
+        e[i] = vf32_add(vf32_mul(a[i], fx), rowEv[i]);
+
+      s32 covered = ~(vf32_lt0_mask(e[0]) | vf32_lt0_mask(e[1]) |
+        vf32_lt0_mask(e[2])) & ((1 << LANES) - 1);
+      if (x1 - x + 1 < LANES)
+        covered &= (1 << (x1 - x + 1)) - 1;
+      if (covered == 0) continue;
+
+      s32 edge = 0;
+      for (s32 i = 0; i < 3; i++)
+        edge |= vf32_lt0_mask(vf32_sub(vf32_mul(e[i], scale[i]), outline));
+
+      f32 z[LANES];
+      vf32_store(z, vf32_add(vf32_mul(dzdx, fx), rowZv));
+
+      for (s32 k = 0; k < LANES; k++) {
+        if (covered & (1 << k))
+          plotPixel(image, row + x + k, z[k],
+            (edge & (1 << k)) ? outlineColor : t->color);
+      }
+    }
+#else
+    for (s32 x = x0; x <= x1; x++) {
+      f32 fx = x + 0.5f;
+      bool inside = true;
+      bool edge = false;
+      for (s32 i = 0; i < 3; i++) {
+        f32 e = t->a[i] * fx + rowE[i];
+        inside = inside && e >= 0;
+        edge = edge || e * t->invLength[i] < OUTLINE_WIDTH;
+      }
+      if (inside)
+        plotPixel(image, row + x, t->dzdx * fx + rowZ,
+          edge ? outlineColor : t->color);
+    }
+#endif
+  }
+}
+
+
+static void rasterizeSpot(
+  Image *image, const RasterSpot *s, s32 tx0, s32 ty0, s32 tx1, s32 ty1)
+{
+  s32 x0 = s->x0 > tx0 ? s->x0 : tx0;
+  s32 x1 = s->x1 < tx1 ? s->x1 : tx1;
+  s32 y0 = s->y0 > ty0 ? s->y0 : ty0;
+  s32 y1 = s->y1 < ty1 ? s->y1 : ty1;
+
+  for (s32 y = y0; y <= y1; y++) {
+    for (s32 x = x0; x <= x1; x++)
+      plotPixel(image, y * image->width + x, s->z, spotColor);
+  }
+}
+
+
+static void *rasterWorker(void *arg) {
+  RasterJob *job = (RasterJob *) arg;
+  Image *image = job->image;
+
+  while (true) {
+    pthread_mutex_lock(&job->lock);
+    s32 tile = job->nextTile++;
+    pthread_mutex_unlock(&job->lock);
+    if (tile >= job->tilesX * job->tilesY) break;
+
+    s32 tx0 = tile % job->tilesX * TILE_SIZE;
+    s32 ty0 = tile / job->tilesX * TILE_SIZE;
+    s32 tx1 = clampInt(tx0 + TILE_SIZE - 1, 0, image->width - 1);
+    s32 ty1 = clampInt(ty0 + TILE_SIZE - 1, 0, image->height - 1);
+
+    for (s32 y = ty0; y <= ty1; y++) {
+      s32 row = y * image->width;
+      memset(&image->rgb[3 * (row + tx0)], 0, 3 * (tx1 - tx0 + 1));
+      for (s32 x = tx0; x <= tx1; x++)
+        image->depth[row + x] = INFINITY;
+    }
+
+    for (s32 i = job->triOffsets[tile]; i < job->triOffsets[tile + 1]; i++)
+      rasterizeTriangle(image, &job->tris[job->triList[i]],
+        tx0, ty0, tx1, ty1);
+    for (s32 i = job->spotOffsets[tile]; i < job->spotOffsets[tile + 1]; i++)
+      rasterizeSpot(image, &job->spots[job->spotList[i]], tx0, ty0, tx1, ty1);
+  }
+
+  return NULL;
+}
+
+
+void renderScene(
+  Image *image,
+  Mtxf view,
+  CollisionWorld *world,
+  const Spot *spots,
+  s32 numSpots,
+  bool spotsOnTop,
+  s32 numThreads)
+{
+  RasterJob job = {0};
+  job.image = image;
+  job.tilesX = (image->width + TILE_SIZE - 1) / TILE_SIZE;
+  job.tilesY = (image->height + TILE_SIZE - 1) / TILE_SIZE;
+
+  addSurfaces(&job, view, world);
+  addSpots(&job, view, spots, numSpots, spotsOnTop);
+
+  binItems(&job, &job.tris[0].x0, sizeof(RasterTriangle) / sizeof(s32),
+    job.numTris, &job.triOffsets, &job.triList);
+  binItems(&job, &job.spots[0].x0, sizeof(RasterSpot) / sizeof(s32),
+    job.numSpots, &job.spotOffsets, &job.spotList);
+
+  pthread_mutex_init(&job.lock, NULL);
+  if (numThreads <= 1) {
+    rasterWorker(&job);
+  }
+  else {
+    pthread_t *threads = (pthread_t *) allocOrDie(
+      numThreads * sizeof(pthread_t));
+    for (s32 i = 0; i < numThreads; i++) {
+      if (pthread_create(&threads[i], NULL, rasterWorker, &job) != 0) {
+        fprintf(stderr, "Failed to create worker thread\n");
+        exit(1);
+      }
+    }
+    for (s32 i = 0; i < numThreads; i++)
+      pthread_join(threads[i], NULL);
+    free(threads);
+  }
+  pthread_mutex_destroy(&job.lock);
+
+  free(job.tris);
+  free(job.spots);
+  free(job.triOffsets);
+  free(job.triList);
+  free(job.spotOffsets);
+  free(job.spotList);
+}
+
+
+bool writeImagePpm(const Image *image, const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) return false;
+
+  size_t size = (size_t) image->width * image->height * 3;
+  bool ok = fprintf(f, "P6\n%d %d\n255\n", image->width, image->height) > 0;
+  ok = ok && fwrite(image->rgb, 1, size, f) == size;
+
+  ok = fclose(f) == 0 && ok;
+  if (!ok) remove(path);
+  return ok;
+}
+
+
+// PNG output, with a small deflate encoder: fixed Huffman codes, and matches
+// only against the previous pixel and the pixel above, which is what flat
+// shaded images repeat
+
+typedef struct {
+  u8 *bytes;
+  size_t size;
+  size_t capacity;
+  u32 bitBuffer;
+  s32 numBits;
+} ByteWriter;
+
+
+static void putByte(ByteWriter *w, u8 b) {
+  if (w->size == w->capacity) {
+    w->capacity = w->capacity > 0 ? 2 * w->capacity : 0x10000;
+    w->bytes = (u8 *) realloc(w->bytes, w->capacity);
+    if (w->bytes == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+  }
+  w->bytes[w->size++] = b;
+}
+
+
+static void putBigEndian32(ByteWriter *w, u32 v) {
+  for (s32 shift = 24; shift >= 0; shift -= 8)
+    putByte(w, (u8) (v >> shift));
+}
+
+
+// Deflate packs bits from the least significant end
+static void putBits(ByteWriter *w, u32 bits, s32 count) {
+  w->bitBuffer |= bits << w->numBits;
+  w->numBits += count;
+  while (w->numBits >= 8) {
+    putByte(w, (u8) w->bitBuffer);
+    w->bitBuffer >>= 8;
+    w->numBits -= 8;
+  }
+}
+
+
+// Huffman codes go most significant bit first
+static void putCode(ByteWriter *w, u32 code, s32 length) {
+  u32 reversed = 0;
+  for (s32 i = 0; i < length; i++)
+    reversed |= ((code >> i) & 1) << (length - 1 - i);
+  putBits(w, reversed, length);
+}
+
+
+static void putLiteral(ByteWriter *w, s32 v) {
+  if (v < 144)
+    putCode(w, 0x30 + v, 8);
+  else if (v < 256)
+    putCode(w, 0x190 + v - 144, 9);
+  else if (v < 280)
+    putCode(w, v - 256, 7);
+  else
+    putCode(w, 0xC0 + v - 280, 8);
+}
+
+
+static const u16 lengthBase[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+  67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const u8 lengthExtra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4,
+  5, 5, 5, 5, 0 };
+static const u16 distanceBase[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+  769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const u8 distanceExtra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+  11, 11, 12, 12, 13, 13 };
+
+
+static void putMatch(ByteWriter *w, s32 length, s32 distance) {
+  s32 l = 28;
+  while (lengthBase[l] > length) l--;
+  putLiteral(w, 257 + l);
+  putBits(w, length - lengthBase[l], lengthExtra[l]);
+
+  s32 d = 29;
+  while (distanceBase[d] > distance) d--;
+  putCode(w, d, 5);
+  putBits(w, distance - distanceBase[d], distanceExtra[d]);
+}
+
+
+static s32 matchLength(const u8 *data, size_t size, size_t pos, s32 distance)
+{
+  if (pos < (size_t) distance) return 0;
+  s32 length = 0;
+  while (length < 258 && pos + length < size &&
+    data[pos + length] == data[pos + length - distance])
+  {
+    length++;
+  }
+  return length;
+}
+
+
+static void deflate(ByteWriter *w, const u8 *data, size_t size, s32 stride) {
+  putBits(w, 1, 1); // final block
+  putBits(w, 1, 2); // fixed Huffman codes
+
+  size_t pos = 0;
+  while (pos < size) {
+    s32 pixel = matchLength(data, size, pos, 3);
+    s32 above = stride <= 32768 ? matchLength(data, size, pos, stride) : 0;
+    s32 length = pixel > above ? pixel : above;
+
+    if (length >= 3) {
+      putMatch(w, length, pixel > above ? 3 : stride);
+      pos += length;
+    }
+    else {
+      putLiteral(w, data[pos++]);
+    }
+  }
+
+  putLiteral(w, 256);
+  if (w->numBits > 0)
+    putBits(w, 0, 8 - w->numBits);
+}
+
+
+static u32 crcTable[256];
+
+
+static u32 updateCrc(u32 crc, const u8 *data, size_t size) {
+  if (crcTable[1] == 0) {
+    for (u32 n = 0; n < 256; n++) {
+      u32 c = n;
+      for (s32 k = 0; k < 8; k++)
+        c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      crcTable[n] = c;
+    }
+  }
+
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++)
+    crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+
+static void putChunk(ByteWriter *w, const char *type, ByteWriter *data) {
+  putBigEndian32(w, (u32) data->size);
+  size_t start = w->size;
+  for (s32 i = 0; i < 4; i++)
+    putByte(w, (u8) type[i]);
+  for (size_t i = 0; i < data->size; i++)
+    putByte(w, data->bytes[i]);
+  putBigEndian32(w, updateCrc(0, &w->bytes[start], w->size - start));
+}
+
+
+bool writeImagePng(const Image *image, const char *path) {
+  // Each row starts with filter type 0 (none)
+  size_t stride = (size_t) image->width * 3 + 1;
+  size_t rawSize = stride * image->height;
+  u8 *raw = (u8 *) allocOrDie(rawSize);
+  for (s32 y = 0; y < image->height; y++) {
+    raw[y * stride] = 0;
+    memcpy(&raw[y * stride + 1], &image->rgb[(size_t) y * image->width * 3],
+      image->width * 3);
+  }
+
+  ByteWriter header = {0};
+  putBigEndian32(&header, image->width);
+  putBigEndian32(&header, image->height);
+  putByte(&header, 8); // bit depth
+  putByte(&header, 2); // RGB
+  putByte(&header, 0);
+  putByte(&header, 0);
+  putByte(&header, 0);
+
+  ByteWriter zlib = {0};
+  putByte(&zlib, 0x78);
+  putByte(&zlib, 0x01);
+  deflate(&zlib, raw, rawSize, (s32) stride);
+  u32 s1 = 1, s2 = 0;
+  for (size_t i = 0; i < rawSize; i++) {
+    s1 = (s1 + raw[i]) % 65521;
+    s2 = (s2 + s1) % 65521;
+  }
+  putBigEndian32(&zlib, s2 << 16 | s1);
+  free(raw);
+
+  ByteWriter end = {0};
+  ByteWriter png = {0};
+  static const u8 signature[8] = {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  for (s32 i = 0; i < 8; i++)
+    putByte(&png, signature[i]);
+  putChunk(&png, "IHDR", &header);
+  putChunk(&png, "IDAT", &zlib);
+  putChunk(&png, "IEND", &end);
+  free(header.bytes);
+  free(zlib.bytes);
+
+  FILE *f = fopen(path, "wb");
+  bool ok = f != NULL && fwrite(png.bytes, 1, png.size, f) == png.size;
+  if (f != NULL) {
+    ok = fclose(f) == 0 && ok;
+    if (!ok) remove(path);
+  }
+  free(png.bytes);
+  return ok;
+}
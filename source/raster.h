@@ -0,0 +1,60 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+
+#include "spots.h"
+#include "surface.h"
+#include "util.h"
+
+
+// Software rasterizer for looking at the ship and its spots without a GPU or
+// a display. It draws what the viewer draws: each surface filled in the
+// color of its classifySurface class with a black outline, and each spot as
+// a white square, depth tested.
+//
+// A view is a 4x4 matrix m[row][col] taking world points (x, y, z, 1), as
+// column vectors, to clip space, with the GL conventions: visible points have
+// x, y and z in [-w, w], and smaller z is nearer.
+//
+// The image is split into tiles, which are rasterized in parallel, several
+// pixels of a row at a time.
+
+#define SPOT_DRAW_SIZE 4
+
+
+typedef struct {
+  s32 width;
+  s32 height;
+  u8 *rgb; // rows top to bottom
+  f32 *depth;
+} Image;
+
+
+void initImage(Image *image, s32 width, s32 height);
+void freeImage(Image *image);
+
+// Looks straight down on the box from lo to hi, with +x to the right and +z
+// down the image. The box is scaled to fit the image and centered.
+void topDownView(Mtxf m, s32 width, s32 height, v3f lo, v3f hi);
+
+// The viewer's camera: a 90 degree frustum from pos, turned by yaw about the
+// y axis and then by pitch, both in radians
+void cameraView(Mtxf m, v3f pos, f32 pitch, f32 yaw);
+
+// With spotsOnTop, spots are drawn over the ship rather than depth tested.
+// Pedro spots always have a ceiling over them, so a top down view would
+// otherwise hide every one.
+void renderScene(
+  Image *image,
+  Mtxf view,
+  CollisionWorld *world,
+  const Spot *spots,
+  s32 numSpots,
+  bool spotsOnTop,
+  s32 numThreads);
+
+bool writeImagePpm(const Image *image, const char *path);
+bool writeImagePng(const Image *image, const char *path);
+
+
+#endif
@@ -0,0 +1,300 @@
+#include "object.h"
+#include "raster.h"
+#include "search.h"
+#include "snapshot.h"
+#include "spotcache.h"
+#include "spots.h"
+#include "stats.h"
+#include "surface.h"
+#include "util.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Headless renderer for the ship and its spots. Draws the ship at each index
+// of a range, with the spots found there, to PREFIX-<index>.png (or .ppm),
+// so a phase animation can be looked at without a GPU or a display.
+//
+// Spots come from a spot store file: one written by ship-batch --store, or
+// the viewer's cache. The spots drawn at an index are those of the pose
+// (roll, index). Without --spots, only the ship is drawn.
+//
+// The top down view frames the ship's bounds over every index, so that
+// frames line up, and draws the spots over the ship. --view camera uses the
+// viewer's camera instead, and hides spots behind surfaces like it does.
+
+
+#define VIEW_TOP 0
+#define VIEW_CAMERA 1
+
+#define FORMAT_PNG 0
+#define FORMAT_PPM 1
+
+
+typedef struct {
+  s32 firstIndex;
+  s32 lastIndex;
+  s32 roll;
+  const char *spotsPath;
+  s32 view;
+  v3f cameraPos;
+  f32 cameraPitch;
+  f32 cameraYaw;
+  s32 size;
+  s32 format;
+  const char *outputPrefix;
+  s32 numThreads;
+} RenderOptions;
+
+
+void printUsage(const char *prog) {
+  fprintf(stderr,
+    "Usage: %s [options]\n"
+    "  -r, --range FIRST[-LAST]         index range (default 0-255)\n"
+    "  --roll R                         ship roll phase (default 0)\n"
+    "  --spots PATH                     spot store to draw (ship-batch\n"
+    "                                   --store, or the viewer's cache)\n"
+    "  --view top|camera                view (default top)\n"
+    "  --camera X,Y,Z,PITCH,YAW         camera for --view camera, angles\n"
+    "                                   in radians (default the viewer's)\n"
+    "  --size N                         image width and height (default "
+    "512)\n"
+    "  --format png|ppm                 image format (default png)\n"
+    "  -o, --output PREFIX              write PREFIX-<index>.<format>\n"
+    "                                   (default frame)\n"
+    "  -j, --threads N                  worker threads (default: all cpus)\n",
+    prog);
+}
+
+
+bool parseCamera(const char *s, RenderOptions *opts) {
+  f32 v[5];
+  const char *p = s;
+  for (s32 i = 0; i < 5; i++) {
+    char *end;
+    v[i] = strtof(p, &end);
+    if (end == p || *end != (i < 4 ? ',' : '\0')) return false;
+    p = end + 1;
+  }
+
+  opts->cameraPos = (v3f) { v[0], v[1], v[2] };
+  opts->cameraPitch = v[3];
+  opts->cameraYaw = v[4];
+  return true;
+}
+
+
+bool parseOptions(int argc, char **argv, RenderOptions *opts) {
+  opts->firstIndex = 0;
+  opts->lastIndex = 0xFF;
+  opts->roll = 0;
+  opts->spotsPath = NULL;
+  opts->view = VIEW_TOP;
+  opts->cameraPos = (v3f) { 3080, 2520, 2375 };
+  opts->cameraPitch = 0;
+  opts->cameraYaw = 3.1415926f / 2;
+  opts->size = 512;
+  opts->format = FORMAT_PNG;
+  opts->outputPrefix = "frame";
+  opts->numThreads = numCpus();
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+    if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+      return false;
+
+    if (value == NULL) {
+      fprintf(stderr, "Unknown option or missing value: %s\n", arg);
+      return false;
+    }
+    i += 1;
+
+    bool ok;
+    if (strcmp(arg, "-r") == 0 || strcmp(arg, "--range") == 0)
+      ok = parseRange(value, &opts->firstIndex, &opts->lastIndex);
+    else if (strcmp(arg, "--roll") == 0)
+      ok = parseInt(value, &opts->roll) && opts->roll >= 0 &&
+        opts->roll <= 0xFF;
+    else if (strcmp(arg, "--spots") == 0) {
+      opts->spotsPath = value;
+      ok = true;
+    }
+    else if (strcmp(arg, "--view") == 0) {
+      ok = true;
+      if (strcmp(value, "top") == 0)
+        opts->view = VIEW_TOP;
+      else if (strcmp(value, "camera") == 0)
+        opts->view = VIEW_CAMERA;
+      else
+        ok = false;
+    }
+    else if (strcmp(arg, "--camera") == 0)
+      ok = parseCamera(value, opts);
+    else if (strcmp(arg, "--size") == 0)
+      ok = parseInt(value, &opts->size) && opts->size > 0 &&
+        opts->size <= 0x4000;
+    else if (strcmp(arg, "--format") == 0) {
+      ok = true;
+      if (strcmp(value, "png") == 0)
+        opts->format = FORMAT_PNG;
+      else if (strcmp(value, "ppm") == 0)
+        opts->format = FORMAT_PPM;
+      else
+        ok = false;
+    }
+    else if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) {
+      opts->outputPrefix = value;
+      ok = true;
+    }
+    else if (strcmp(arg, "-j") == 0 || strcmp(arg, "--threads") == 0)
+      ok = parseInt(value, &opts->numThreads) && opts->numThreads > 0;
+    else {
+      fprintf(stderr, "Unknown option: %s\n", arg);
+      return false;
+    }
+
+    if (!ok) {
+      fprintf(stderr, "Invalid value for %s: %s\n", arg, value);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+// Bounding box of the ship over all indices, padded by a margin
+void getShipBounds(ShipSnapshots *snapshots, v3f *lo, v3f *hi) {
+  *lo = (v3f) { 1e9f, 1e9f, 1e9f };
+  *hi = (v3f) { -1e9f, -1e9f, -1e9f };
+
+  for (s32 i = 0; i < 0x100; i++) {
+    CollisionWorld *world = shipSnapshotWorld(snapshots, i);
+    for (s32 j = 0; j < world->surfacesAllocated; j++) {
+      Surface *s = worldSurface(world, j);
+      v3h vs[3] = { s->vertex1, s->vertex2, s->vertex3 };
+      for (s32 k = 0; k < 3; k++) {
+        if (vs[k].x < lo->x) lo->x = vs[k].x;
+        if (vs[k].y < lo->y) lo->y = vs[k].y;
+        if (vs[k].z < lo->z) lo->z = vs[k].z;
+        if (vs[k].x > hi->x) hi->x = vs[k].x;
+        if (vs[k].y > hi->y) hi->y = vs[k].y;
+        if (vs[k].z > hi->z) hi->z = vs[k].z;
+      }
+    }
+  }
+
+  f32 pad = 100.0f;
+  lo->x -= pad;
+  lo->y -= pad;
+  lo->z -= pad;
+  hi->x += pad;
+  hi->y += pad;
+  hi->z += pad;
+}
+
+
+// Maps a spot store file whatever its key, since the key only matters for
+// deciding whether a cache is stale
+bool openSpots(SpotCache *cache, const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return false;
+  }
+
+  SpotCacheHeader header;
+  bool ok = fread(&header, sizeof(header), 1, f) == 1;
+  fclose(f);
+
+  if (!ok || !mapSpotCache(cache, path, header.key)) {
+    fprintf(stderr, "Not a spot store: %s\n", path);
+    return false;
+  }
+  return true;
+}
+
+
+int main(int argc, char **argv) {
+  RenderOptions opts;
+  if (!parseOptions(argc, argv, &opts)) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  SpotCache spots = {0};
+  if (opts.spotsPath != NULL && !openSpots(&spots, opts.spotsPath))
+    return 1;
+
+  Object ship;
+  initJrbShipAfloat(&ship);
+  setPlatformFixedPhase(&ship, opts.roll);
+  initStaticPartition();
+  ShipSnapshots *snapshots = buildShipSnapshots(&ship, NULL);
+
+  Mtxf view;
+  if (opts.view == VIEW_TOP) {
+    v3f lo, hi;
+    getShipBounds(snapshots, &lo, &hi);
+    topDownView(view, opts.size, opts.size, lo, hi);
+  }
+  else {
+    cameraView(view, opts.cameraPos, opts.cameraPitch, opts.cameraYaw);
+  }
+
+  Image image;
+  initImage(&image, opts.size, opts.size);
+  SpotBuffer indexSpots;
+  initSpotBuffer(&indexSpots);
+
+  const char *ext = opts.format == FORMAT_PNG ? "png" : "ppm";
+  size_t pathSize = strlen(opts.outputPrefix) + 16;
+  char *path = (char *) malloc(pathSize);
+  if (path == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+
+  f64 renderNs = 0;
+  f64 writeNs = 0;
+  for (s32 index = opts.firstIndex; index <= opts.lastIndex; index++) {
+    clearSpotBuffer(&indexSpots);
+    if (spots.data != NULL)
+      getStoreSpots(&spots.store, shipPoseIndex(opts.roll, index),
+        &indexSpots);
+
+    f64 startNs = nowNs();
+    renderScene(&image, view, shipSnapshotWorld(snapshots, index),
+      indexSpots.spots, indexSpots.count, opts.view == VIEW_TOP,
+      opts.numThreads);
+    f64 renderedNs = nowNs();
+
+    snprintf(path, pathSize, "%s-%03d.%s", opts.outputPrefix, index, ext);
+    bool ok = opts.format == FORMAT_PNG ?
+      writeImagePng(&image, path) : writeImagePpm(&image, path);
+    if (!ok) {
+      fprintf(stderr, "Failed to write %s\n", path);
+      return 1;
+    }
+
+    renderNs += renderedNs - startNs;
+    writeNs += nowNs() - renderedNs;
+  }
+
+  s32 numFrames = opts.lastIndex - opts.firstIndex + 1;
+  printf("Rendered %d frames at %dx%d: %.2f ms/frame, %.2f ms/frame to "
+    "write\n", numFrames, opts.size, opts.size,
+    renderNs / 1e6 / numFrames, writeNs / 1e6 / numFrames);
+
+  free(path);
+  freeSpotBuffer(&indexSpots);
+  freeImage(&image);
+  freeShipSnapshots(snapshots);
+  unmapSpotCache(&spots);
+  return 0;
+}
@@ -0,0 +1,329 @@
+#include "search.h"
+
+#include "heightmap.h"
+#include "object.h"
+#include "snapshot.h"
+#include "spotcache.h"
+#include "spots.h"
+#include "stats.h"
+#include "surface.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+
+void initSearchParams(SearchParams *params) {
+  params->pedroCeilOffset = PEDRO_CEIL_OFFSET;
+  params->pedroMaxClearance = PEDRO_MAX_CLEARANCE;
+  params->volatileMinDrop = VOLATILE_MIN_DROP;
+}
+
+
+// Number of integer cells whose sample points are queried in one
+// worldFindFloorBatch call
+#define VOLATILE_BATCH 64
+
+typedef struct {
+  s32 numCells;
+  s16 x[VOLATILE_BATCH];
+  s16 z[VOLATILE_BATCH];
+  f32 y[VOLATILE_BATCH];
+  v3f ps[4 * VOLATILE_BATCH];
+} VolatileBatch;
+
+
+static void flushVolatileBatch(
+  CollisionWorld *world,
+  const SearchParams *params,
+  VolatileBatch *b,
+  SpotBuffer *spots)
+{
+  f32 fh[4 * VOLATILE_BATCH];
+  Surface *floors[4 * VOLATILE_BATCH];
+  worldFindFloorBatch(world, b->ps, 4 * b->numCells, fh, floors);
+
+  for (s32 c = 0; c < b->numCells; c++) {
+    int numVol = 0;
+
+    for (int i = 4 * c; i < 4 * c + 4; i++) {
+      if (b->ps[i].y > fh[i] + params->volatileMinDrop)
+        numVol += 1;
+    }
+
+    if (numVol > 0)
+      pushSpot(spots, b->x[c], b->z[c], b->y[c]);
+  }
+
+  b->numCells = 0;
+}
+
+
+static void findVolatileSpotsForSurface(
+  CollisionWorld *world,
+  const SearchParams *params,
+  Surface *s,
+  SurfaceHeightMap *m0,
+  SpotBuffer *spots)
+{
+  if (classifySurface(s) != 'f') return;
+  if (s->object == NULL) return;
+
+  VolatileBatch b;
+  b.numCells = 0;
+
+  for (s16 x = m0->x0; x <= m0->x1; x++) {
+    for (s16 z = m0->z0; z <= m0->z1; z++) {
+      f32 y0 = map_get(m0, x, z);
+      if (y0 == map_none) continue;
+
+      v3f *ps = &b.ps[4 * b.numCells];
+      ps[0] = (v3f) {x+0.05f, y0, z+0.05f};
+      ps[1] = (v3f) {x+0.95f, y0, z+0.05f};
+      ps[2] = (v3f) {x+0.05f, y0, z+0.95f};
+      ps[3] = (v3f) {x+0.95f, y0, z+0.95f};
+
+      for (int i = 0; i < 4; i++)
+        applyPlatformDisplacement(&ps[i], NULL, s->object);
+
+      b.x[b.numCells] = x;
+      b.z[b.numCells] = z;
+      b.y[b.numCells] = y0;
+      if (++b.numCells == VOLATILE_BATCH)
+        flushVolatileBatch(world, params, &b, spots);
+    }
+  }
+
+  flushVolatileBatch(world, params, &b, spots);
+}
+
+
+// Height maps come from the ship at index, and floors from the ship one frame
+// later, displaced by the ship's movement in between
+void findVolatileSpots(
+  ShipSnapshots *snapshots,
+  const SearchParams *params,
+  s32 index,
+  HeightMapStore *maps,
+  SpotBuffer *spots)
+{
+  CollisionWorld *world0 = shipSnapshotWorld(snapshots, index);
+  resetHeightMapStore(maps, world0);
+
+  CollisionWorld *world = shipSnapshotWorld(snapshots, index + 1);
+
+  for (int i = world->numStaticSurfaces; i < world->surfacesAllocated; i++) {
+    Surface *s = worldSurface(world, i);
+    if (classifySurface(s) != 'f') continue;
+    if (s->object == NULL) continue;
+    SurfaceHeightMap *m0 = getSurfaceHeightMap(maps, i);
+
+    findVolatileSpotsForSurface(world, params, s, m0, spots);
+  }
+}
+
+
+void findPedroSpots(
+  ShipSnapshots *snapshots,
+  const SearchParams *params,
+  s32 index,
+  HeightMapStore *maps,
+  SpotBuffer *spots)
+{
+  CollisionWorld *world = shipSnapshotWorld(snapshots, index);
+  resetHeightMapStore(maps, world);
+
+  // Only the ship's floors are searched; a loaded level's surfaces only
+  // affect the floor and ceiling queries
+  for (int i = world->numStaticSurfaces; i < world->surfacesAllocated; i++) {
+    Surface *s = worldSurface(world, i);
+    if (classifySurface(s) != 'f') continue;
+    SurfaceHeightMap *m = getSurfaceHeightMap(maps, i);
+
+    for (s16 z = m->z0; z <= m->z1; z++) {
+      for (s16 x = m->x0; x <= m->x1; x++) {
+        f32 y = map_get(m, x, z);
+        if (y == map_none) continue;
+
+        Surface *ceil;
+        v3f p = { x, y + params->pedroCeilOffset, z };
+        f32 ch = worldFindCeil(world, p, &ceil);
+
+        if (!(ch - y > params->pedroMaxClearance))
+          pushSpot(spots, x, z, y);
+      }
+    }
+  }
+}
+
+
+// Indices are handed out to workers from a shared counter. The workers only
+// read the shared ship snapshots, so the per-index results don't depend on
+// which worker ran them. Each worker keeps its own height map store and
+// reuses it for every index it runs.
+//
+// Results go to the sink in index order. The worker that completes the next
+// index to be sunk also sinks the completed indices after it, outside the
+// lock, while the others keep searching. No index is started more than
+// window indices past the next one to be sunk, so at most window spot sets
+// are held at once, in buffers that are reused from one index to the next.
+
+typedef struct {
+  SpotSearch search;
+  ShipSnapshots *snapshots;
+  const SearchParams *params;
+  SpotSink sink;
+  void *sinkData;
+  s32 lastIndex;
+  s32 nextIndex;
+  s32 nextSunk;
+  bool sinking;
+  s32 window;
+  SpotBuffer *pending; // indexed by index % window
+  bool *done;
+  pthread_mutex_t lock;
+  pthread_cond_t sunk;
+} SearchQueue;
+
+
+static void *searchWorker(void *arg) {
+  SearchQueue *q = (SearchQueue *) arg;
+
+  HeightMapStore maps;
+  initHeightMapStore(&maps);
+
+  while (true) {
+    pthread_mutex_lock(&q->lock);
+    while (q->nextIndex <= q->lastIndex &&
+      q->nextIndex >= q->nextSunk + q->window)
+    {
+      pthread_cond_wait(&q->sunk, &q->lock);
+    }
+    s32 idx = q->nextIndex++;
+    pthread_mutex_unlock(&q->lock);
+    if (idx > q->lastIndex) break;
+
+    // The slot's previous index has been sunk, and no other worker touches
+    // it until this one is marked done
+    SpotBuffer *spots = &q->pending[idx % q->window];
+    clearSpotBuffer(spots);
+    STAT_TIMER_START(STAT_TIME_SEARCH);
+    q->search(q->snapshots, q->params, idx, &maps, spots);
+    STAT_TIMER_STOP(STAT_TIME_SEARCH);
+
+    pthread_mutex_lock(&q->lock);
+    q->done[idx % q->window] = true;
+    if (!q->sinking) {
+      q->sinking = true;
+      while (q->nextSunk <= q->lastIndex && q->done[q->nextSunk % q->window]) {
+        s32 i = q->nextSunk;
+        pthread_mutex_unlock(&q->lock);
+        q->sink(q->sinkData, i, &q->pending[i % q->window]);
+        pthread_mutex_lock(&q->lock);
+        q->done[i % q->window] = false;
+        q->nextSunk += 1;
+        pthread_cond_broadcast(&q->sunk);
+      }
+      q->sinking = false;
+    }
+    pthread_mutex_unlock(&q->lock);
+  }
+
+  freeHeightMapStore(&maps);
+  mergeThreadStats();
+  return NULL;
+}
+
+
+// Runs search for each index in [firstIndex, lastIndex], passing the spots
+// for each index to sink
+void runSearch(
+  SpotSearch search,
+  ShipSnapshots *snapshots,
+  const SearchParams *params,
+  s32 firstIndex,
+  s32 lastIndex,
+  s32 numThreads,
+  SpotSink sink,
+  void *sinkData)
+{
+  SearchQueue q = {0};
+  q.search = search;
+  q.snapshots = snapshots;
+  q.params = params;
+  q.sink = sink;
+  q.sinkData = sinkData;
+  q.lastIndex = lastIndex;
+  q.nextIndex = firstIndex;
+  q.nextSunk = firstIndex;
+  q.window = 2 * (numThreads > 1 ? numThreads : 1);
+  q.pending = (SpotBuffer *) malloc(q.window * sizeof(SpotBuffer));
+  q.done = (bool *) calloc(q.window, sizeof(bool));
+  if (q.pending == NULL || q.done == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  for (s32 i = 0; i < q.window; i++)
+    initSpotBuffer(&q.pending[i]);
+  pthread_mutex_init(&q.lock, NULL);
+  pthread_cond_init(&q.sunk, NULL);
+
+  if (numThreads <= 1) {
+    searchWorker(&q);
+  }
+  else {
+    pthread_t *threads = (pthread_t *) malloc(numThreads * sizeof(pthread_t));
+    if (threads == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+
+    for (s32 i = 0; i < numThreads; i++) {
+      if (pthread_create(&threads[i], NULL, searchWorker, &q) != 0) {
+        fprintf(stderr, "Failed to create worker thread\n");
+        exit(1);
+      }
+    }
+    for (s32 i = 0; i < numThreads; i++)
+      pthread_join(threads[i], NULL);
+
+    free(threads);
+  }
+
+  pthread_cond_destroy(&q.sunk);
+  pthread_mutex_destroy(&q.lock);
+  for (s32 i = 0; i < q.window; i++)
+    freeSpotBuffer(&q.pending[i]);
+  free(q.pending);
+  free(q.done);
+}
+
+
+// Identifies the inputs of the Pedro search, for the spot cache
+u64 pedroSpotsKey(Object *o, const SearchParams *params) {
+  u64 key = hashBytes(0xCBF29CE484222325ull, "pedro", 5);
+  key = hashBytes(key, o->behavior->name, strlen(o->behavior->name));
+  key = hashCollisionModel(key, o->collisionModel);
+  key = hashBytes(key, &o->pos, sizeof(o->pos));
+  key = hashBytes(key, &o->scale, sizeof(o->scale));
+  key = hashBytes(key, &o->v0F8, sizeof(o->v0F8));
+
+  f32 thresholds[] = { params->pedroCeilOffset, params->pedroMaxClearance };
+  return hashBytes(key, thresholds, sizeof(thresholds));
+}
+
+
+s32 numCpus(void) {
+#ifdef WIN32
+  const char *n = getenv("NUMBER_OF_PROCESSORS");
+  s32 count = n != NULL ? atoi(n) : 1;
+#else
+  s32 count = (s32) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return count > 0 ? count : 1;
+}
@@ -0,0 +1,75 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+
+#include "heightmap.h"
+#include "object.h"
+#include "snapshot.h"
+#include "spots.h"
+#include "util.h"
+
+
+// Pedro spots are floor points where Mario's ceiling check, done this far above
+// the floor, finds a ceiling within the given clearance
+#define PEDRO_CEIL_OFFSET 80.0f
+#define PEDRO_MAX_CLEARANCE 160.0f
+
+// A sample point is volatile if after platform displacement it is more than
+// this far above the floor
+#define VOLATILE_MIN_DROP 100.0f
+
+
+typedef struct {
+  f32 pedroCeilOffset;
+  f32 pedroMaxClearance;
+  f32 volatileMinDrop;
+} SearchParams;
+
+
+// A search appends the spots for one index to spots. maps is scratch space
+// owned by the calling thread.
+typedef void (*SpotSearch)(
+  ShipSnapshots *snapshots,
+  const SearchParams *params,
+  s32 index,
+  HeightMapStore *maps,
+  SpotBuffer *spots);
+
+
+// Receives the spots of each index from runSearch, in index order. The buffer
+// is reused once the sink returns; a sink can keep the spots by taking the
+// buffer and leaving it initialized.
+typedef void (*SpotSink)(void *data, s32 index, SpotBuffer *spots);
+
+
+void initSearchParams(SearchParams *params);
+
+void findVolatileSpots(
+  ShipSnapshots *snapshots,
+  const SearchParams *params,
+  s32 index,
+  HeightMapStore *maps,
+  SpotBuffer *spots);
+
+void findPedroSpots(
+  ShipSnapshots *snapshots,
+  const SearchParams *params,
+  s32 index,
+  HeightMapStore *maps,
+  SpotBuffer *spots);
+
+void runSearch(
+  SpotSearch search,
+  ShipSnapshots *snapshots,
+  const SearchParams *params,
+  s32 firstIndex,
+  s32 lastIndex,
+  s32 numThreads,
+  SpotSink sink,
+  void *sinkData);
+
+u64 pedroSpotsKey(Object *o, const SearchParams *params);
+s32 numCpus(void);
+
+
+#endif
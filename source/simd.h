@@ -0,0 +1,140 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+
+// Thin layer over the widest of AVX2 / SSE2 the build targets. LANES is the
+// number of s32 or f32 lanes in a vector, or 1 if there is no vector support,
+// in which case none of the vector types or macros are defined.
+//
+// Float operations map to separate multiplies and adds, never fused, so the
+// results match the scalar code built with -std=c99.
+//
+// vf32_shuffle and the s16x4 loads and stores work within each 128 bit half
+// of a vector. vf32_shuffle(a, b, i, j, k, l) gives a[i], a[j], b[k], b[l]
+// in each half. vf32_load_s16x4(p, stride) converts four s16 values per half,
+// p[0..3] into the first and p[stride..stride + 3] into the second, and
+// vs32_store_s16x4 stores them back the same way, truncated like an (s16)
+// cast.
+
+
+#include "util.h"
+
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+#if defined(__AVX2__)
+
+#define LANES 8
+
+typedef __m256i vs32;
+typedef __m256 vf32;
+
+#define vs32_set1(a) _mm256_set1_epi32(a)
+#define vs32_load(p) _mm256_loadu_si256((const __m256i *) (p))
+#define vs32_sub(a, b) _mm256_sub_epi32(a, b)
+#define vs32_mul(a, b) _mm256_mullo_epi32(a, b)
+#define vs32_or(a, b) _mm256_or_si256(a, b)
+#define vs32_lt0(a) _mm256_cmpgt_epi32(_mm256_setzero_si256(), a)
+#define vs32_mask(a) _mm256_movemask_ps(_mm256_castsi256_ps(a))
+#define vs32_to_f32(a) _mm256_cvtepi32_ps(a)
+
+#define vf32_set1(a) _mm256_set1_ps(a)
+#define vf32_add(a, b) _mm256_add_ps(a, b)
+#define vf32_sub(a, b) _mm256_sub_ps(a, b)
+#define vf32_mul(a, b) _mm256_mul_ps(a, b)
+#define vf32_div(a, b) _mm256_div_ps(a, b)
+#define vf32_neg(a) _mm256_xor_ps(a, _mm256_set1_ps(-0.0f))
+#define vf32_lt0_mask(a) \
+  _mm256_movemask_ps(_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_LT_OQ))
+#define vf32_store(p, a) _mm256_storeu_ps(p, a)
+#define vf32_load(p) _mm256_loadu_ps(p)
+#define vf32_to_s32_trunc(a) _mm256_cvttps_epi32(a)
+#define vs32_store(p, a) _mm256_storeu_si256((__m256i *) (p), a)
+
+#define vf32_shuffle(a, b, i, j, k, l) \
+  _mm256_shuffle_ps(a, b, _MM_SHUFFLE(l, k, j, i))
+
+static inline __m256 vf32_load_s16x4(const s16 *p, s32 stride) {
+  __m128i v = _mm_unpacklo_epi64(
+    _mm_loadl_epi64((const __m128i *) p),
+    _mm_loadl_epi64((const __m128i *) (p + stride)));
+  return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(v));
+}
+
+static inline void vs32_store_s16x4(s16 *p, s32 stride, __m256i a) {
+  __m256i w = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+  w = _mm256_packs_epi32(w, w);
+  _mm_storel_epi64((__m128i *) p, _mm256_castsi256_si128(w));
+  _mm_storel_epi64((__m128i *) (p + stride), _mm256_extracti128_si256(w, 1));
+}
+
+#elif defined(__SSE2__)
+
+#define LANES 4
+
+typedef __m128i vs32;
+typedef __m128 vf32;
+
+#define vs32_set1(a) _mm_set1_epi32(a)
+#define vs32_load(p) _mm_loadu_si128((const __m128i *) (p))
+#define vs32_sub(a, b) _mm_sub_epi32(a, b)
+#define vs32_or(a, b) _mm_or_si128(a, b)
+#define vs32_lt0(a) _mm_cmplt_epi32(a, _mm_setzero_si128())
+#define vs32_mask(a) _mm_movemask_ps(_mm_castsi128_ps(a))
+#define vs32_to_f32(a) _mm_cvtepi32_ps(a)
+
+#if defined(__SSE4_1__)
+#define vs32_mul(a, b) _mm_mullo_epi32(a, b)
+#else
+// Low 32 bits of each product, which is what a wrapping s32 multiply gives
+static inline __m128i vs32_mul(__m128i a, __m128i b) {
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(
+    _mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+    _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+#endif
+
+#define vf32_set1(a) _mm_set1_ps(a)
+#define vf32_add(a, b) _mm_add_ps(a, b)
+#define vf32_sub(a, b) _mm_sub_ps(a, b)
+#define vf32_mul(a, b) _mm_mul_ps(a, b)
+#define vf32_div(a, b) _mm_div_ps(a, b)
+#define vf32_neg(a) _mm_xor_ps(a, _mm_set1_ps(-0.0f))
+#define vf32_lt0_mask(a) _mm_movemask_ps(_mm_cmplt_ps(a, _mm_setzero_ps()))
+#define vf32_store(p, a) _mm_storeu_ps(p, a)
+#define vf32_load(p) _mm_loadu_ps(p)
+#define vf32_to_s32_trunc(a) _mm_cvttps_epi32(a)
+#define vs32_store(p, a) _mm_storeu_si128((__m128i *) (p), a)
+
+#define vf32_shuffle(a, b, i, j, k, l) \
+  _mm_shuffle_ps(a, b, _MM_SHUFFLE(l, k, j, i))
+
+static inline __m128 vf32_load_s16x4(const s16 *p, s32 stride) {
+  (void) stride;
+  __m128i v = _mm_loadl_epi64((const __m128i *) p);
+  return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+
+static inline void vs32_store_s16x4(s16 *p, s32 stride, __m128i a) {
+  (void) stride;
+  __m128i w = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+  _mm_storel_epi64((__m128i *) p, _mm_packs_epi32(w, w));
+}
+
+#else
+
+#define LANES 1
+
+#endif
+
+
+#endif
@@ -0,0 +1,77 @@
+#include "snapshot.h"
+
+#include "level.h"
+#include "object.h"
+#include "stats.h"
+#include "surface.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+ShipSnapshots *buildPlatformSnapshots(
+  Object *platforms, s32 numPlatforms, LevelCollision *level)
+{
+  ShipSnapshots *snapshots = (ShipSnapshots *) malloc(sizeof(ShipSnapshots));
+  Object *objects = (Object *) malloc(0x100 * numPlatforms * sizeof(Object));
+  if (snapshots == NULL || objects == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  snapshots->numObjects = numPlatforms;
+  snapshots->objects = objects;
+
+  for (s32 i = 0; i < 0x100; i++) {
+    Object *o = &objects[numPlatforms * i];
+    for (s32 j = 0; j < numPlatforms; j++) {
+      o[j] = platforms[j];
+      setPlatformIndex(&o[j], i - 1);
+      updatePlatform(&o[j]);
+    }
+
+    CollisionWorld *world = newCollisionWorld();
+    if (world == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+
+    STAT_TIMER_START(STAT_TIME_LOAD_MODEL);
+    if (level != NULL)
+      worldCopyStaticSurfaces(world, level->world);
+    worldLoadObjectCollisionModels(world, o, numPlatforms);
+    STAT_TIMER_STOP(STAT_TIME_LOAD_MODEL);
+
+    STAT_TIMER_START(STAT_TIME_COMPILE);
+    worldSetFineGrid(world, true);
+    worldCompilePartitions(world);
+    STAT_TIMER_STOP(STAT_TIME_COMPILE);
+
+    snapshots->worlds[i] = world;
+  }
+
+  return snapshots;
+}
+
+
+ShipSnapshots *buildShipSnapshots(Object *ship, LevelCollision *level) {
+  return buildPlatformSnapshots(ship, 1, level);
+}
+
+
+void freeShipSnapshots(ShipSnapshots *snapshots) {
+  for (s32 i = 0; i < 0x100; i++)
+    freeCollisionWorld(snapshots->worlds[i]);
+  free(snapshots->objects);
+  free(snapshots);
+}
+
+
+CollisionWorld *shipSnapshotWorld(ShipSnapshots *snapshots, s32 index) {
+  return snapshots->worlds[index & 0xFF];
+}
+
+
+Object *shipSnapshotObject(ShipSnapshots *snapshots, s32 index) {
+  return &snapshots->objects[snapshots->numObjects * (index & 0xFF)];
+}
@@ -0,0 +1,50 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+
+#include "level.h"
+#include "object.h"
+#include "surface.h"
+#include "util.h"
+
+
+// The ship's pose depends only on the oscillation index (for a fixed v0F8),
+// so its collision can be built once per index and shared. Snapshot i holds
+// a compiled world with just the ship loaded at index i, along with the ship
+// object its surfaces point to. The object is left as updateJrbShipAfloat
+// leaves it when stepping from index i - 1, so its platformRotation is the
+// displacement between the two phases.
+//
+// buildPlatformSnapshots loads other platforms alongside the ship (the first
+// object), each stepped to the same index through its behavior. A platform
+// whose period isn't a divisor of 0x100 is only seen at those 0x100 frames.
+//
+// If a level is given, each world starts with a copy of its static surfaces.
+//
+// The snapshots cover one roll phase, the one the ship's v0F8 was set to
+// (see setPlatformFixedPhase). Sweeping every roll means building a set of
+// snapshots per roll. A pose is numbered roll * 0x100 + index, so the poses
+// at roll 0 keep the index numbering.
+#define NUM_SHIP_POSES 0x10000
+
+static inline s32 shipPoseIndex(s32 roll, s32 index) {
+  return (roll & 0xFF) << 8 | (index & 0xFF);
+}
+
+
+typedef struct {
+  s32 numObjects;
+  Object *objects; // numObjects per index, the ship first
+  CollisionWorld *worlds[0x100];
+} ShipSnapshots;
+
+
+ShipSnapshots *buildShipSnapshots(Object *ship, LevelCollision *level);
+ShipSnapshots *buildPlatformSnapshots(
+  Object *platforms, s32 numPlatforms, LevelCollision *level);
+void freeShipSnapshots(ShipSnapshots *snapshots);
+CollisionWorld *shipSnapshotWorld(ShipSnapshots *snapshots, s32 index);
+Object *shipSnapshotObject(ShipSnapshots *snapshots, s32 index);
+
+
+#endif
@@ -0,0 +1,103 @@
+#include "spotcache.h"
+
+#include "mapfile.h"
+#include "spotstore.h"
+#include "surface.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// FNV-1a
+u64 hashBytes(u64 hash, const void *data, size_t size) {
+  const u8 *bytes = (const u8 *) data;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001B3ull;
+  }
+  return hash;
+}
+
+
+// Hashes a collision model in the format loadObjectCollisionModel reads
+u64 hashCollisionModel(u64 hash, s16 *model) {
+  s16 *data = model + 1;
+  s16 numVerts = *data++;
+  data += 3 * numVerts;
+
+  while (*data != 0x41) {
+    s16 surfaceType = *data++;
+    s32 numTris = *data++;
+    data += (surfaceHasForce(surfaceType) ? 4 : 3) * numTris;
+  }
+
+  return hashBytes(hash, model, (data + 1 - model) * sizeof(s16));
+}
+
+
+bool writeSpotCache(const char *path, u64 key, const SpotStore *store) {
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) return false;
+
+  SpotCacheHeader header = {0};
+  header.magic = SPOT_CACHE_MAGIC;
+  header.version = SPOT_CACHE_VERSION;
+  header.key = key;
+  header.numIndices = store->numIndices;
+  header.numBlocks = store->numBlocks;
+  header.numCells = store->numCells;
+  header.numRuns = store->numRuns;
+  header.numHeights = store->numHeights;
+  header.numLoose = store->numLoose;
+
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+  ok = ok && fwrite(store->data, 1, store->size, f) == store->size;
+
+  ok = fclose(f) == 0 && ok;
+  if (!ok) remove(path);
+  return ok;
+}
+
+
+bool mapSpotCache(SpotCache *cache, const char *path, u64 key) {
+  memset(cache, 0, sizeof(SpotCache));
+
+  size_t size;
+  void *data = mapFile(path, &size, false);
+  if (data == NULL) return false;
+
+  const SpotCacheHeader *header = (const SpotCacheHeader *) data;
+  bool valid = size >= sizeof(SpotCacheHeader) &&
+    header->magic == SPOT_CACHE_MAGIC &&
+    header->version == SPOT_CACHE_VERSION &&
+    header->key == key &&
+    header->numIndices <= 0x7FFFFFFF && header->numBlocks < 0x7FFFFFFF &&
+    header->numCells < 0x7FFFFFFF && header->numRuns <= 0x7FFFFFFF &&
+    header->numHeights <= 0x7FFFFFFF && header->numLoose <= 0x7FFFFFFF;
+
+  valid = valid && size == sizeof(SpotCacheHeader) + spotStoreDataSize(
+    header->numIndices, header->numBlocks, header->numCells,
+    header->numRuns, header->numHeights, header->numLoose);
+  valid = valid && setSpotStoreData(&cache->store, (void *) (header + 1),
+    header->numIndices, header->numBlocks, header->numCells,
+    header->numRuns, header->numHeights, header->numLoose);
+
+  if (!valid) {
+    unmapFile(data, size);
+    return false;
+  }
+
+  cache->data = data;
+  cache->size = size;
+  cache->header = header;
+  return true;
+}
+
+
+void unmapSpotCache(SpotCache *cache) {
+  if (cache->data != NULL)
+    unmapFile(cache->data, cache->size);
+  memset(cache, 0, sizeof(SpotCache));
+}
@@ -0,0 +1,55 @@
+#ifndef SPOTCACHE_H
+#define SPOTCACHE_H
+
+
+#include "spotstore.h"
+#include "util.h"
+
+#include <stddef.h>
+
+
+// Binary file holding the spots for each index of a sweep, as a SpotStore:
+//
+//   SpotCacheHeader
+//   the store's arrays (see spotStoreDataSize)
+//
+// The file is written in native byte order; the magic doubles as a byte order
+// check. key identifies the inputs (collision model and search parameters)
+// the spots were computed from, and a file with a different key is ignored.
+// Files that aren't used as a cache (ship-batch --store) have key 0.
+
+#define SPOT_CACHE_MAGIC 0x544F5053 // "SPOT"
+#define SPOT_CACHE_VERSION 2
+
+
+typedef struct {
+  u32 magic;
+  u32 version;
+  u64 key;
+  u32 numIndices;
+  u32 numBlocks;
+  u32 numCells;
+  u32 numRuns;
+  u32 numHeights;
+  u32 numLoose;
+} SpotCacheHeader;
+
+
+typedef struct {
+  void *data;
+  size_t size;
+  const SpotCacheHeader *header;
+  SpotStore store; // points into data
+} SpotCache;
+
+
+u64 hashBytes(u64 hash, const void *data, size_t size);
+u64 hashCollisionModel(u64 hash, s16 *model);
+
+bool writeSpotCache(const char *path, u64 key, const SpotStore *store);
+
+bool mapSpotCache(SpotCache *cache, const char *path, u64 key);
+void unmapSpotCache(SpotCache *cache);
+
+
+#endif
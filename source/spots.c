@@ -0,0 +1,47 @@
+#include "spots.h"
+
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+void initSpotBuffer(SpotBuffer *b) {
+  b->spots = NULL;
+  b->count = 0;
+  b->capacity = 0;
+}
+
+
+void freeSpotBuffer(SpotBuffer *b) {
+  free(b->spots);
+  initSpotBuffer(b);
+}
+
+
+void reserveSpots(SpotBuffer *b, s32 capacity) {
+  if (capacity <= b->capacity) return;
+
+  Spot *spots = (Spot *) realloc(b->spots, capacity * sizeof(Spot));
+  if (spots == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  b->spots = spots;
+  b->capacity = capacity;
+}
+
+
+void appendSpots(SpotBuffer *b, const Spot *spots, s32 count) {
+  if (b->count + count > b->capacity) {
+    s32 capacity = b->capacity > 0 ? b->capacity : 256;
+    while (capacity < b->count + count)
+      capacity *= 2;
+    reserveSpots(b, capacity);
+  }
+
+  memcpy(&b->spots[b->count], spots, count * sizeof(Spot));
+  b->count += count;
+}
@@ -0,0 +1,45 @@
+#ifndef SPOTS_H
+#define SPOTS_H
+
+
+#include "util.h"
+
+
+typedef struct {
+  s16 x;
+  s16 z;
+  f32 y;
+} Spot;
+
+
+// Growable array of spots. The memory is kept when the buffer is cleared, so
+// a buffer can be reused across indices without going back to the allocator.
+typedef struct {
+  Spot *spots;
+  s32 count;
+  s32 capacity;
+} SpotBuffer;
+
+
+void initSpotBuffer(SpotBuffer *b);
+void freeSpotBuffer(SpotBuffer *b);
+void reserveSpots(SpotBuffer *b, s32 capacity);
+void appendSpots(SpotBuffer *b, const Spot *spots, s32 count);
+
+
+static inline void clearSpotBuffer(SpotBuffer *b) {
+  b->count = 0;
+}
+
+
+static inline void pushSpot(SpotBuffer *b, s16 x, s16 z, f32 y) {
+  if (b->count == b->capacity)
+    reserveSpots(b, b->capacity > 0 ? 2 * b->capacity : 256);
+  Spot *s = &b->spots[b->count++];
+  s->x = x;
+  s->z = z;
+  s->y = y;
+}
+
+
+#endif
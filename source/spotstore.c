@@ -0,0 +1,604 @@
+#include "spotstore.h"
+
+#include "spots.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static u32 heightBits(f32 y) {
+  u32 bits;
+  memcpy(&bits, &y, sizeof(bits));
+  return bits;
+}
+
+
+static u64 spotKey(const Spot *s) {
+  return (u64) (u16) s->x << 48 | (u64) (u16) s->z << 32 | heightBits(s->y);
+}
+
+
+static int compareSpotKeys(const void *a, const void *b) {
+  u64 ka = spotKey((const Spot *) a);
+  u64 kb = spotKey((const Spot *) b);
+  return ka < kb ? -1 : ka > kb ? 1 : 0;
+}
+
+
+// Orders runs by cell, then by first index. Runs that only differ in their
+// group of 255 spots keep the order they were added in.
+static int compareBuildRuns(const void *a, const void *b) {
+  const SpotStoreBuildRun *ra = (const SpotStoreBuildRun *) a;
+  const SpotStoreBuildRun *rb = (const SpotStoreBuildRun *) b;
+  if (ra->x != rb->x) return ra->x < rb->x ? -1 : 1;
+  if (ra->z != rb->z) return ra->z < rb->z ? -1 : 1;
+  if (ra->run.firstIndex != rb->run.firstIndex)
+    return ra->run.firstIndex < rb->run.firstIndex ? -1 : 1;
+  return ra->run.firstHeight < rb->run.firstHeight ? -1 : 1;
+}
+
+
+static void *growArray(void *p, s32 *capacity, s32 needed, size_t elemSize) {
+  if (needed <= *capacity) return p;
+
+  s32 newCapacity = *capacity > 0 ? *capacity : 256;
+  while (newCapacity < needed)
+    newCapacity *= 2;
+
+  p = realloc(p, newCapacity * elemSize);
+  if (p == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  *capacity = newCapacity;
+  return p;
+}
+
+
+static void allocTable(SpotStoreBuilder *b, s32 capacity) {
+  b->table = (SpotStoreEntry *) malloc(capacity * sizeof(SpotStoreEntry));
+  if (b->table == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  for (s32 i = 0; i < capacity; i++)
+    b->table[i].run = -1;
+  b->tableCapacity = capacity;
+  b->tableCount = 0;
+}
+
+
+// Returns the entry for key, or the empty entry where it would go. The table
+// is never full, so the probe ends.
+static SpotStoreEntry *findEntry(SpotStoreBuilder *b, u64 key) {
+  u64 h = key * 0x9E3779B97F4A7C15ull;
+  s32 mask = b->tableCapacity - 1;
+  s32 i = (s32) (h >> 32) & mask;
+
+  while (b->table[i].run >= 0 && b->table[i].key != key)
+    i = (i + 1) & mask;
+  return &b->table[i];
+}
+
+
+static void growTable(SpotStoreBuilder *b) {
+  SpotStoreEntry *old = b->table;
+  s32 oldCapacity = b->tableCapacity;
+
+  allocTable(b, 2 * oldCapacity);
+  for (s32 i = 0; i < oldCapacity; i++) {
+    if (old[i].run < 0) continue;
+    *findEntry(b, old[i].key) = old[i];
+    b->tableCount += 1;
+  }
+  free(old);
+}
+
+
+void initSpotStoreBuilder(SpotStoreBuilder *b, s32 numIndices) {
+  memset(b, 0, sizeof(SpotStoreBuilder));
+  b->numIndices = numIndices;
+  b->lastIndex = -1;
+
+  s32 numBlocks = (numIndices + SPOT_STORE_BLOCK - 1) / SPOT_STORE_BLOCK;
+  b->blockCells = (u32 *) calloc(numBlocks + 1, sizeof(u32));
+  b->counts = (u32 *) calloc(numIndices > 0 ? numIndices : 1, sizeof(u32));
+  b->looseOffsets = (u32 *) calloc(numIndices + 1, sizeof(u32));
+  if (b->blockCells == NULL || b->counts == NULL || b->looseOffsets == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  allocTable(b, 1024);
+  initSpotBuffer(&b->loose);
+  initSpotBuffer(&b->sorted);
+}
+
+
+// Returns true if every index of the run has the same heights as the first
+static bool heightsConstant(const f32 *heights, s32 count, s32 numHeights) {
+  for (s32 i = count; i < numHeights; i++) {
+    if (heightBits(heights[i]) != heightBits(heights[i % count]))
+      return false;
+  }
+  return true;
+}
+
+
+static bool isLoose(const SpotStoreBuildRun *r, const SpotStoreBuildRun *runs,
+  s32 numRuns)
+{
+  if (r->run.count != 1 || r->run.firstIndex != r->run.lastIndex)
+    return false;
+  return (r == runs || r[-1].x != r->x || r[-1].z != r->z) &&
+    (r + 1 == runs + numRuns || r[1].x != r->x || r[1].z != r->z);
+}
+
+
+// Moves the block's loose spots to b->loose, in index order, and removes
+// their runs
+static void takeLooseSpots(SpotStoreBuilder *b) {
+  s32 looseAt[SPOT_STORE_BLOCK + 1] = {0};
+  bool *loose = (bool *) malloc(b->numBlockRuns + 1);
+  if (loose == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  for (s32 i = 0; i < b->numBlockRuns; i++) {
+    SpotStoreBuildRun *r = &b->blockRuns[i];
+    loose[i] = isLoose(r, b->blockRuns, b->numBlockRuns);
+    if (loose[i])
+      looseAt[r->run.firstIndex + 1] += 1;
+  }
+  for (s32 i = 0; i < SPOT_STORE_BLOCK; i++)
+    looseAt[i + 1] += looseAt[i];
+
+  s32 base = b->loose.count;
+  s32 first = b->block * SPOT_STORE_BLOCK;
+  for (s32 i = first; i < first + SPOT_STORE_BLOCK && i < b->numIndices; i++)
+    b->looseOffsets[i + 1] = base + looseAt[i - first + 1];
+  reserveSpots(&b->loose, base + looseAt[SPOT_STORE_BLOCK]);
+  b->loose.count = base + looseAt[SPOT_STORE_BLOCK];
+
+  s32 numRuns = 0;
+  for (s32 i = 0; i < b->numBlockRuns; i++) {
+    SpotStoreBuildRun *r = &b->blockRuns[i];
+    if (loose[i]) {
+      Spot *s = &b->loose.spots[base + looseAt[r->run.firstIndex]++];
+      s->x = r->x;
+      s->z = r->z;
+      s->y = b->scratch[r->run.firstHeight];
+    }
+    else {
+      b->blockRuns[numRuns++] = *r;
+    }
+  }
+  b->numBlockRuns = numRuns;
+
+  free(loose);
+}
+
+
+// Sorts the current block's runs into cells, gathers each run's heights, and
+// starts the next block
+static void flushBlock(SpotStoreBuilder *b) {
+  // Heights were added index by index, so each run's are in index order.
+  // Until the runs are sorted, firstHeight is where they go in scratch.
+  s32 offset = 0;
+  for (s32 i = 0; i < b->numBlockRuns; i++) {
+    b->blockRuns[i].run.firstHeight = offset;
+    offset += b->blockRuns[i].numHeights;
+  }
+
+  b->scratch = (f32 *) growArray(b->scratch, &b->scratchCapacity,
+    b->numBlockHeights, sizeof(f32));
+  for (s32 i = 0; i < b->numBlockHeights; i++) {
+    SpotStoreBuildHeight *h = &b->blockHeights[i];
+    b->scratch[b->blockRuns[h->run].run.firstHeight++] = h->y;
+  }
+  for (s32 i = 0; i < b->numBlockRuns; i++)
+    b->blockRuns[i].run.firstHeight -= b->blockRuns[i].numHeights;
+
+  qsort(b->blockRuns, b->numBlockRuns, sizeof(SpotStoreBuildRun),
+    compareBuildRuns);
+  takeLooseSpots(b);
+
+  b->runs = (SpotRun *) growArray(b->runs, &b->runsCapacity,
+    b->numRuns + b->numBlockRuns, sizeof(SpotRun));
+  b->heights = (f32 *) growArray(b->heights, &b->heightsCapacity,
+    b->numHeights + b->numBlockHeights, sizeof(f32));
+
+  for (s32 i = 0; i < b->numBlockRuns; i++) {
+    SpotStoreBuildRun *r = &b->blockRuns[i];
+    if (i == 0 || r->x != r[-1].x || r->z != r[-1].z) {
+      b->cells = (SpotCell *) growArray(b->cells, &b->cellsCapacity,
+        b->numCells + 1, sizeof(SpotCell));
+      SpotCell *c = &b->cells[b->numCells++];
+      c->x = r->x;
+      c->z = r->z;
+      c->firstRun = b->numRuns;
+    }
+
+    const f32 *heights = &b->scratch[r->run.firstHeight];
+    s32 numHeights = r->numHeights;
+    if (heightsConstant(heights, r->run.count, numHeights)) {
+      r->run.flags |= SPOT_RUN_CONSTANT;
+      numHeights = r->run.count;
+    }
+
+    if (numHeights == 1) {
+      r->run.flags |= SPOT_RUN_INLINE;
+      r->run.y = heights[0];
+    }
+    else {
+      r->run.firstHeight = b->numHeights;
+      memcpy(&b->heights[b->numHeights], heights, numHeights * sizeof(f32));
+      b->numHeights += numHeights;
+    }
+    b->runs[b->numRuns++] = r->run;
+  }
+
+  b->block += 1;
+  b->blockCells[b->block] = b->numCells;
+
+  b->numBlockRuns = 0;
+  b->numBlockHeights = 0;
+  for (s32 i = 0; i < b->tableCapacity; i++)
+    b->table[i].run = -1;
+  b->tableCount = 0;
+}
+
+
+void addStoreSpots(
+  SpotStoreBuilder *b, s32 index, const Spot *spots, s32 count)
+{
+  if (index <= b->lastIndex || index >= b->numIndices) {
+    fprintf(stderr, "Spot store index %d out of order\n", index);
+    exit(1);
+  }
+
+  while (b->block < index / SPOT_STORE_BLOCK)
+    flushBlock(b);
+  b->lastIndex = index;
+  b->counts[index] = count;
+
+  // Sorted so that a cell's spots are adjacent, in order of height bits
+  clearSpotBuffer(&b->sorted);
+  appendSpots(&b->sorted, spots, count);
+  Spot *sorted = b->sorted.spots;
+  qsort(sorted, count, sizeof(Spot), compareSpotKeys);
+
+  b->blockHeights = (SpotStoreBuildHeight *) growArray(b->blockHeights,
+    &b->blockHeightsCapacity, b->numBlockHeights + count,
+    sizeof(SpotStoreBuildHeight));
+
+  s32 local = index % SPOT_STORE_BLOCK;
+  s32 group = 0;
+  for (s32 i = 0; i < count; ) {
+    if (i > 0 && sorted[i].x == sorted[i - 1].x &&
+      sorted[i].z == sorted[i - 1].z)
+    {
+      group += 1;
+    }
+    else {
+      group = 0;
+    }
+
+    s32 j = i + 1;
+    while (j < count && j - i < 0xFF &&
+      sorted[j].x == sorted[i].x && sorted[j].z == sorted[i].z)
+    {
+      j++;
+    }
+    s32 n = j - i;
+
+    u64 key = (u64) (u16) sorted[i].x << 48 | (u64) (u16) sorted[i].z << 32 |
+      (u32) group;
+    SpotStoreEntry *e = findEntry(b, key);
+
+    s32 run = -1;
+    if (e->run >= 0) {
+      SpotStoreBuildRun *r = &b->blockRuns[e->run];
+      if (r->run.lastIndex + 1 == local && r->run.count == n) {
+        r->run.lastIndex = (u8) local;
+        r->numHeights += n;
+        run = e->run;
+      }
+    }
+
+    if (run < 0) {
+      b->blockRuns = (SpotStoreBuildRun *) growArray(b->blockRuns,
+        &b->blockRunsCapacity, b->numBlockRuns + 1,
+        sizeof(SpotStoreBuildRun));
+      run = b->numBlockRuns++;
+
+      SpotStoreBuildRun *r = &b->blockRuns[run];
+      r->x = sorted[i].x;
+      r->z = sorted[i].z;
+      r->run.firstIndex = (u8) local;
+      r->run.lastIndex = (u8) local;
+      r->run.count = (u8) n;
+      r->run.flags = 0;
+      r->run.firstHeight = 0;
+      r->numHeights = n;
+
+      bool added = e->run < 0;
+      e->key = key;
+      e->run = run;
+      if (added && ++b->tableCount * 2 > b->tableCapacity)
+        growTable(b);
+    }
+
+    for (; i < j; i++) {
+      SpotStoreBuildHeight *h = &b->blockHeights[b->numBlockHeights++];
+      h->run = run;
+      h->y = sorted[i].y;
+    }
+  }
+}
+
+
+size_t spotStoreDataSize(
+  s32 numIndices,
+  s32 numBlocks,
+  s32 numCells,
+  s32 numRuns,
+  s32 numHeights,
+  s32 numLoose)
+{
+  return (numBlocks + 1) * sizeof(u32) +
+    (numCells + 1) * sizeof(SpotCell) +
+    numRuns * sizeof(SpotRun) +
+    numHeights * sizeof(f32) +
+    numIndices * sizeof(u32) +
+    (numIndices + 1) * sizeof(u32) +
+    numLoose * sizeof(Spot);
+}
+
+
+void finishSpotStore(SpotStoreBuilder *b, SpotStore *store) {
+  s32 numBlocks = (b->numIndices + SPOT_STORE_BLOCK - 1) / SPOT_STORE_BLOCK;
+  while (b->block < numBlocks)
+    flushBlock(b);
+
+  size_t size = spotStoreDataSize(b->numIndices, numBlocks,
+    b->numCells, b->numRuns, b->numHeights, b->loose.count);
+  u8 *data = (u8 *) malloc(size);
+  if (data == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  SpotCell sentinel = { 0, 0, (u32) b->numRuns };
+  u8 *p = data;
+  memcpy(p, b->blockCells, (numBlocks + 1) * sizeof(u32));
+  p += (numBlocks + 1) * sizeof(u32);
+  memcpy(p, b->cells, b->numCells * sizeof(SpotCell));
+  p += b->numCells * sizeof(SpotCell);
+  memcpy(p, &sentinel, sizeof(SpotCell));
+  p += sizeof(SpotCell);
+  memcpy(p, b->runs, b->numRuns * sizeof(SpotRun));
+  p += b->numRuns * sizeof(SpotRun);
+  memcpy(p, b->heights, b->numHeights * sizeof(f32));
+  p += b->numHeights * sizeof(f32);
+  memcpy(p, b->counts, b->numIndices * sizeof(u32));
+  p += b->numIndices * sizeof(u32);
+  memcpy(p, b->looseOffsets, (b->numIndices + 1) * sizeof(u32));
+  p += (b->numIndices + 1) * sizeof(u32);
+  memcpy(p, b->loose.spots, b->loose.count * sizeof(Spot));
+
+  setSpotStoreData(store, data, b->numIndices, numBlocks,
+    b->numCells, b->numRuns, b->numHeights, b->loose.count);
+  store->ownsData = true;
+
+  free(b->blockRuns);
+  free(b->blockHeights);
+  free(b->table);
+  free(b->blockCells);
+  free(b->cells);
+  free(b->runs);
+  free(b->heights);
+  free(b->counts);
+  free(b->looseOffsets);
+  freeSpotBuffer(&b->loose);
+  free(b->scratch);
+  freeSpotBuffer(&b->sorted);
+  memset(b, 0, sizeof(SpotStoreBuilder));
+}
+
+
+void freeSpotStore(SpotStore *store) {
+  if (store->ownsData)
+    free(store->data);
+  memset(store, 0, sizeof(SpotStore));
+}
+
+
+static s32 runHeightCount(const SpotRun *run) {
+  if (run->flags & SPOT_RUN_INLINE) return 0;
+  if (run->flags & SPOT_RUN_CONSTANT) return run->count;
+  return run->count * (run->lastIndex - run->firstIndex + 1);
+}
+
+
+bool setSpotStoreData(
+  SpotStore *store,
+  void *data,
+  s32 numIndices,
+  s32 numBlocks,
+  s32 numCells,
+  s32 numRuns,
+  s32 numHeights,
+  s32 numLoose)
+{
+  memset(store, 0, sizeof(SpotStore));
+  if (numIndices < 0 || numCells < 0 || numRuns < 0 || numHeights < 0 ||
+    numLoose < 0 ||
+    numBlocks != (numIndices + SPOT_STORE_BLOCK - 1) / SPOT_STORE_BLOCK)
+  {
+    return false;
+  }
+
+  const u8 *p = (const u8 *) data;
+  const u32 *blockCells = (const u32 *) p;
+  p += (numBlocks + 1) * sizeof(u32);
+  const SpotCell *cells = (const SpotCell *) p;
+  p += (numCells + 1) * sizeof(SpotCell);
+  const SpotRun *runs = (const SpotRun *) p;
+  p += numRuns * sizeof(SpotRun);
+  const f32 *heights = (const f32 *) p;
+  p += numHeights * sizeof(f32);
+  const u32 *counts = (const u32 *) p;
+  p += numIndices * sizeof(u32);
+  const u32 *looseOffsets = (const u32 *) p;
+  p += (numIndices + 1) * sizeof(u32);
+  const Spot *looseSpots = (const Spot *) p;
+
+  // Checked so that queries stay within the arrays and the index range
+  bool valid = blockCells[0] == 0 && blockCells[numBlocks] == (u32) numCells &&
+    cells[numCells].firstRun == (u32) numRuns &&
+    (numCells == 0 || cells[0].firstRun == 0);
+  for (s32 i = 0; valid && i < numBlocks; i++) {
+    valid = blockCells[i] <= blockCells[i + 1];
+    s32 blockIndices = numIndices - i * SPOT_STORE_BLOCK;
+
+    for (u32 c = blockCells[i]; valid && c < blockCells[i + 1]; c++) {
+      valid = cells[c].firstRun <= cells[c + 1].firstRun;
+      for (u32 r = cells[c].firstRun; valid && r < cells[c + 1].firstRun; r++)
+      {
+        const SpotRun *run = &runs[r];
+        bool inlined = run->flags & SPOT_RUN_INLINE;
+        valid = run->firstIndex <= run->lastIndex &&
+          run->lastIndex < blockIndices && run->count > 0 &&
+          (!inlined || (run->count == 1 && (run->flags & SPOT_RUN_CONSTANT)))
+          && (inlined || (run->firstHeight <= (u32) numHeights &&
+            runHeightCount(run) <= numHeights - (s32) run->firstHeight));
+      }
+    }
+  }
+  valid = valid && looseOffsets[0] == 0 &&
+    looseOffsets[numIndices] == (u32) numLoose;
+  for (s32 i = 0; valid && i < numIndices; i++)
+    valid = looseOffsets[i] <= looseOffsets[i + 1];
+  if (!valid) return false;
+
+  store->numIndices = numIndices;
+  store->numBlocks = numBlocks;
+  store->numCells = numCells;
+  store->numRuns = numRuns;
+  store->numHeights = numHeights;
+  store->numLoose = numLoose;
+  store->blockCells = blockCells;
+  store->cells = cells;
+  store->runs = runs;
+  store->heights = heights;
+  store->counts = counts;
+  store->looseOffsets = looseOffsets;
+  store->looseSpots = looseSpots;
+  store->data = data;
+  store->size = spotStoreDataSize(
+    numIndices, numBlocks, numCells, numRuns, numHeights, numLoose);
+  store->ownsData = false;
+  return true;
+}
+
+
+s32 spotStoreCount(const SpotStore *store, s32 index) {
+  if (index < 0 || index >= store->numIndices) return 0;
+  return store->counts[index];
+}
+
+
+void getStoreSpots(const SpotStore *store, s32 index, SpotBuffer *spots) {
+  if (index < 0 || index >= store->numIndices) return;
+
+  s32 block = index / SPOT_STORE_BLOCK;
+  s32 local = index % SPOT_STORE_BLOCK;
+  reserveSpots(spots, spots->count + store->counts[index]);
+
+  for (u32 c = store->blockCells[block]; c < store->blockCells[block + 1]; c++)
+  {
+    const SpotCell *cell = &store->cells[c];
+    for (u32 r = cell->firstRun; r < cell[1].firstRun; r++) {
+      const SpotRun *run = &store->runs[r];
+      if (run->firstIndex > local) break;
+      if (run->lastIndex < local) continue;
+
+      if (run->flags & SPOT_RUN_INLINE) {
+        pushSpot(spots, cell->x, cell->z, run->y);
+        continue;
+      }
+
+      const f32 *heights = &store->heights[run->firstHeight];
+      if (!(run->flags & SPOT_RUN_CONSTANT))
+        heights += (local - run->firstIndex) * run->count;
+      for (s32 k = 0; k < run->count; k++)
+        pushSpot(spots, cell->x, cell->z, heights[k]);
+    }
+  }
+
+  u32 first = store->looseOffsets[index];
+  appendSpots(spots, &store->looseSpots[first],
+    store->looseOffsets[index + 1] - first);
+}
+
+
+const SpotCell *findSpotCell(const SpotStore *store, s32 block, s16 x, s16 z) {
+  if (block < 0 || block >= store->numBlocks) return NULL;
+
+  s32 lo = store->blockCells[block];
+  s32 hi = store->blockCells[block + 1];
+  while (lo < hi) {
+    s32 mid = lo + (hi - lo) / 2;
+    const SpotCell *c = &store->cells[mid];
+    if (c->x == x && c->z == z) return c;
+    if (c->x < x || (c->x == x && c->z < z))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return NULL;
+}
+
+
+// Returns true if index has a loose spot at (x, z). They are sorted by cell.
+static bool hasLooseSpot(const SpotStore *store, s32 index, s16 x, s16 z) {
+  s32 lo = store->looseOffsets[index];
+  s32 hi = store->looseOffsets[index + 1];
+  while (lo < hi) {
+    s32 mid = lo + (hi - lo) / 2;
+    const Spot *s = &store->looseSpots[mid];
+    if (s->x == x && s->z == z) return true;
+    if (s->x < x || (s->x == x && s->z < z))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return false;
+}
+
+
+void getSpotCellIndices(const SpotStore *store, s16 x, s16 z, u64 *mask) {
+  memset(mask, 0, (store->numIndices + 63) / 64 * sizeof(u64));
+
+  for (s32 block = 0; block < store->numBlocks; block++) {
+    const SpotCell *cell = findSpotCell(store, block, x, z);
+    if (cell == NULL) continue;
+
+    for (u32 r = cell->firstRun; r < cell[1].firstRun; r++) {
+      const SpotRun *run = &store->runs[r];
+      for (s32 i = run->firstIndex; i <= run->lastIndex; i++) {
+        s32 index = block * SPOT_STORE_BLOCK + i;
+        mask[index / 64] |= 1ull << (index % 64);
+      }
+    }
+  }
+
+  for (s32 index = 0; index < store->numIndices; index++) {
+    if (hasLooseSpot(store, index, x, z))
+      mask[index / 64] |= 1ull << (index % 64);
+  }
+}
@@ -0,0 +1,188 @@
+#ifndef SPOTSTORE_H
+#define SPOTSTORE_H
+
+
+#include "spots.h"
+#include "util.h"
+
+#include <stddef.h>
+
+
+// Spots for a range of indices, stored once per run of consecutive indices
+// rather than once per index. Most cells that have a spot at one index still
+// have one at the next, so this is much smaller than a SpotBuffer per index.
+//
+// The indices are split into blocks of SPOT_STORE_BLOCK (one roll's worth of
+// ship poses, see shipPoseIndex). Within a block, each (x, z) cell that has a
+// spot at any index gets a SpotCell, and the cells are sorted by x, then z.
+// A cell's runs each cover consecutive indices (relative to the block) where
+// the cell has count spots, and are sorted by first index. The heights of a
+// run are in heights[firstHeight...], count per index, in order of their
+// bits. The ship moves between indices, so the heights usually change too;
+// if they don't, the run is marked SPOT_RUN_CONSTANT and only one index's
+// worth is stored. A constant run of single spots keeps its height in y
+// instead.
+//
+// A spot that is alone in its cell and doesn't last past its index would
+// cost a cell and a run, so those are kept as plain Spots instead, in
+// looseSpots[looseOffsets[i], looseOffsets[i + 1]) for index i. Most
+// volatile spots are like this.
+//
+// Spots don't come back in the order the search found them. Heights are
+// compared by their bits, so -0.0 and 0.0 stay distinct.
+
+#define SPOT_STORE_BLOCK 0x100
+
+#define SPOT_RUN_CONSTANT 0x01
+#define SPOT_RUN_INLINE 0x02
+
+
+typedef struct {
+  u8 firstIndex;
+  u8 lastIndex;
+  u8 count;
+  u8 flags;
+  union { u32 firstHeight; f32 y; };
+} SpotRun;
+
+
+// The runs of cells[i] are runs[cells[i].firstRun, cells[i + 1].firstRun).
+// A block's cells are followed by the next block's, and the last cell by a
+// sentinel whose firstRun is numRuns.
+typedef struct {
+  s16 x;
+  s16 z;
+  u32 firstRun;
+} SpotCell;
+
+
+// The arrays are laid out back to back in data, in the order below, which
+// is also how a spot cache file holds them (see spotcache.h). data is owned
+// by the store if it was built, or is a mapped file.
+typedef struct {
+  s32 numIndices;
+  s32 numBlocks;
+  s32 numCells;
+  s32 numRuns;
+  s32 numHeights;
+  s32 numLoose;
+  const u32 *blockCells; // numBlocks + 1 offsets into cells
+  const SpotCell *cells; // numCells + 1, with the sentinel
+  const SpotRun *runs;
+  const f32 *heights;
+  const u32 *counts; // spots at each index
+  const u32 *looseOffsets; // numIndices + 1
+  const Spot *looseSpots;
+  void *data;
+  size_t size;
+  bool ownsData;
+} SpotStore;
+
+
+typedef struct {
+  s16 x;
+  s16 z;
+  SpotRun run;
+  s32 numHeights;
+} SpotStoreBuildRun;
+
+
+typedef struct {
+  s32 run;
+  f32 y;
+} SpotStoreBuildHeight;
+
+
+typedef struct {
+  u64 key;
+  s32 run;
+} SpotStoreEntry;
+
+
+// Builds a store from each index's spots in turn. Indices must be added in
+// increasing order; an index that is skipped has no spots. Memory grows with
+// the number of runs, plus a hash table for the current block.
+typedef struct {
+  s32 numIndices;
+  s32 block;
+  s32 lastIndex;
+
+  // Runs of the current block, before they are sorted into cells, and their
+  // heights in the order they were added
+  SpotStoreBuildRun *blockRuns;
+  s32 numBlockRuns;
+  s32 blockRunsCapacity;
+  SpotStoreBuildHeight *blockHeights;
+  s32 numBlockHeights;
+  s32 blockHeightsCapacity;
+
+  // Maps a cell (and, past 255 spots, which group of 255) to its latest run
+  // in the block
+  SpotStoreEntry *table;
+  s32 tableCapacity;
+  s32 tableCount;
+
+  u32 *blockCells;
+  SpotCell *cells;
+  s32 numCells;
+  s32 cellsCapacity;
+  SpotRun *runs;
+  s32 numRuns;
+  s32 runsCapacity;
+  f32 *heights;
+  s32 numHeights;
+  s32 heightsCapacity;
+  u32 *counts;
+  u32 *looseOffsets;
+  SpotBuffer loose;
+
+  SpotBuffer sorted;
+  f32 *scratch;
+  s32 scratchCapacity;
+} SpotStoreBuilder;
+
+
+void initSpotStoreBuilder(SpotStoreBuilder *b, s32 numIndices);
+void addStoreSpots(
+  SpotStoreBuilder *b, s32 index, const Spot *spots, s32 count);
+
+// Moves the runs into store and frees the rest of the builder
+void finishSpotStore(SpotStoreBuilder *b, SpotStore *store);
+void freeSpotStore(SpotStore *store);
+
+// Size of the arrays of a store with the given dimensions
+size_t spotStoreDataSize(
+  s32 numIndices,
+  s32 numBlocks,
+  s32 numCells,
+  s32 numRuns,
+  s32 numHeights,
+  s32 numLoose);
+
+// Points the store's arrays into data, which must hold spotStoreDataSize
+// bytes. Returns false if the offsets in data are inconsistent.
+bool setSpotStoreData(
+  SpotStore *store,
+  void *data,
+  s32 numIndices,
+  s32 numBlocks,
+  s32 numCells,
+  s32 numRuns,
+  s32 numHeights,
+  s32 numLoose);
+
+s32 spotStoreCount(const SpotStore *store, s32 index);
+
+// Appends the spots at index to spots
+void getStoreSpots(const SpotStore *store, s32 index, SpotBuffer *spots);
+
+// Returns the cell at (x, z) in block, or NULL if it has no runs there (it
+// may still have loose spots)
+const SpotCell *findSpotCell(const SpotStore *store, s32 block, s16 x, s16 z);
+
+// Sets bit i of mask (u64 words, numIndices bits) for each index i with a
+// spot at (x, z)
+void getSpotCellIndices(const SpotStore *store, s16 x, s16 z, u64 *mask);
+
+
+#endif
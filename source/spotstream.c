@@ -0,0 +1,237 @@
+#include "spotstream.h"
+
+#include "spots.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// A packed spot is at most three varints: two of 17 bits and one of 32
+#define MAX_PACKED_SPOT_SIZE 11
+
+
+static void reserveBytes(u8 **bytes, size_t *capacity, size_t size) {
+  if (size <= *capacity) return;
+
+  size_t newCapacity = *capacity > 0 ? *capacity : 4096;
+  while (newCapacity < size)
+    newCapacity *= 2;
+
+  u8 *p = (u8 *) realloc(*bytes, newCapacity);
+  if (p == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  *bytes = p;
+  *capacity = newCapacity;
+}
+
+
+static u8 *putVarint(u8 *p, u32 v) {
+  while (v >= 0x80) {
+    *p++ = (u8) (v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (u8) v;
+  return p;
+}
+
+
+// Returns NULL if the varint runs past end or doesn't fit in 32 bits
+static const u8 *getVarint(const u8 *p, const u8 *end, u32 *v) {
+  u32 result = 0;
+  for (s32 shift = 0; shift < 35; shift += 7) {
+    if (p == end) return NULL;
+    u8 b = *p++;
+    result |= (u32) (b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      *v = result;
+      return p;
+    }
+  }
+  return NULL;
+}
+
+
+static u32 zigzag(s32 v) {
+  return (u32) v << 1 ^ (u32) (v >> 31);
+}
+
+
+static s32 unzigzag(u32 v) {
+  return (s32) (v >> 1) ^ -(s32) (v & 1);
+}
+
+
+static u32 heightBits(f32 y) {
+  u32 bits;
+  memcpy(&bits, &y, sizeof(bits));
+  return bits;
+}
+
+
+static size_t packSpots(u8 *bytes, const Spot *spots, s32 count) {
+  u8 *p = bytes;
+  s32 x = 0;
+  s32 z = 0;
+  u32 y = 0;
+
+  for (s32 i = 0; i < count; i++) {
+    const Spot *s = &spots[i];
+    u32 ybits = heightBits(s->y);
+    p = putVarint(p, zigzag(s->x - x));
+    p = putVarint(p, zigzag(s->z - z));
+    p = putVarint(p, zigzag((s32) (ybits - y)));
+    x = s->x;
+    z = s->z;
+    y = ybits;
+  }
+
+  return p - bytes;
+}
+
+
+static bool unpackSpots(
+  const u8 *bytes, size_t size, Spot *spots, s32 count)
+{
+  const u8 *p = bytes;
+  const u8 *end = bytes + size;
+  s32 x = 0;
+  s32 z = 0;
+  u32 y = 0;
+
+  for (s32 i = 0; i < count; i++) {
+    u32 dx, dz, dy;
+    p = getVarint(p, end, &dx);
+    if (p != NULL) p = getVarint(p, end, &dz);
+    if (p != NULL) p = getVarint(p, end, &dy);
+    if (p == NULL) return false;
+
+    x += unzigzag(dx);
+    z += unzigzag(dz);
+    y += (u32) unzigzag(dy);
+    if (x != (s16) x || z != (s16) z) return false;
+
+    spots[i].x = (s16) x;
+    spots[i].z = (s16) z;
+    memcpy(&spots[i].y, &y, sizeof(y));
+  }
+
+  return p == end;
+}
+
+
+bool initSpotStreamWriter(SpotStreamWriter *w, FILE *f, bool packed) {
+  w->f = f;
+  w->packed = packed;
+  w->bytes = NULL;
+  w->capacity = 0;
+
+  SpotStreamHeader header = { SPOT_STREAM_MAGIC, SPOT_STREAM_VERSION };
+  return fwrite(&header, sizeof(header), 1, f) == 1;
+}
+
+
+void freeSpotStreamWriter(SpotStreamWriter *w) {
+  free(w->bytes);
+  w->bytes = NULL;
+  w->capacity = 0;
+}
+
+
+bool writeSpotRecord(
+  SpotStreamWriter *w,
+  const char *sweep,
+  s32 pose,
+  const Spot *spots,
+  s32 count)
+{
+  size_t nameLength = strlen(sweep);
+  if (nameLength > MAX_SPOT_SWEEP_NAME) return false;
+
+  SpotRecordHeader header = {0};
+  header.pose = pose;
+  header.count = count;
+  header.nameLength = (u8) nameLength;
+
+  const void *data = spots;
+  if (w->packed) {
+    reserveBytes(&w->bytes, &w->capacity,
+      (size_t) count * MAX_PACKED_SPOT_SIZE);
+    header.size = (u32) packSpots(w->bytes, spots, count);
+    header.flags = SPOT_RECORD_PACKED;
+    data = w->bytes;
+  }
+  else {
+    header.size = count * sizeof(Spot);
+  }
+
+  return fwrite(&header, sizeof(header), 1, w->f) == 1 &&
+    fwrite(sweep, 1, nameLength, w->f) == nameLength &&
+    fwrite(data, 1, header.size, w->f) == header.size;
+}
+
+
+bool initSpotStreamReader(SpotStreamReader *r, FILE *f) {
+  memset(r, 0, sizeof(SpotStreamReader));
+
+  SpotStreamHeader header;
+  if (fread(&header, sizeof(header), 1, f) != 1 ||
+    header.magic != SPOT_STREAM_MAGIC || header.version != SPOT_STREAM_VERSION)
+  {
+    rewind(f);
+    return false;
+  }
+
+  r->f = f;
+  return true;
+}
+
+
+void freeSpotStreamReader(SpotStreamReader *r) {
+  free(r->bytes);
+  r->bytes = NULL;
+  r->capacity = 0;
+}
+
+
+s32 readSpotRecord(SpotStreamReader *r, SpotBuffer *spots) {
+  SpotRecordHeader header;
+  size_t n = fread(&header, 1, sizeof(header), r->f);
+  if (n == 0 && feof(r->f)) return 0;
+  if (n != sizeof(header)) return -1;
+
+  bool packed = header.flags & SPOT_RECORD_PACKED;
+  if (header.nameLength > MAX_SPOT_SWEEP_NAME ||
+    header.count > 0x7FFFFFFF / sizeof(Spot) ||
+    (!packed && header.size != header.count * sizeof(Spot)) ||
+    (packed && header.size > header.count * MAX_PACKED_SPOT_SIZE))
+  {
+    return -1;
+  }
+
+  if (fread(r->sweep, 1, header.nameLength, r->f) != header.nameLength)
+    return -1;
+  r->sweep[header.nameLength] = '\0';
+  r->pose = header.pose;
+
+  clearSpotBuffer(spots);
+  reserveSpots(spots, header.count);
+
+  if (!packed) {
+    if (fread(spots->spots, 1, header.size, r->f) != header.size) return -1;
+  }
+  else {
+    reserveBytes(&r->bytes, &r->capacity, header.size);
+    if (fread(r->bytes, 1, header.size, r->f) != header.size ||
+      !unpackSpots(r->bytes, header.size, spots->spots, header.count))
+    {
+      return -1;
+    }
+  }
+
+  spots->count = header.count;
+  return 1;
+}
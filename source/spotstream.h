@@ -0,0 +1,91 @@
+#ifndef SPOTSTREAM_H
+#define SPOTSTREAM_H
+
+
+#include "spots.h"
+#include "util.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+
+// Binary file of spot sets, written one record per sweep and pose as soon as
+// the pose is searched:
+//
+//   SpotStreamHeader
+//   SpotRecordHeader, sweep name, spots
+//   ...
+//
+// Records can come in any order, and the spots of a record are in the order
+// the search found them. Like the spot cache, the file is in native byte
+// order, with the magic as a byte order check.
+//
+// With SPOT_RECORD_PACKED, the spots are delta coded against the previous
+// spot of the record: x and z as zigzag varints, and y's bits as a zigzag
+// varint of their difference as a signed integer, which is small for nearby
+// heights of the same sign. Otherwise they are plain Spots.
+
+#define SPOT_STREAM_MAGIC 0x4D525453 // "STRM"
+#define SPOT_STREAM_VERSION 1
+
+#define SPOT_RECORD_PACKED 0x01
+
+#define MAX_SPOT_SWEEP_NAME 31
+
+
+typedef struct {
+  u32 magic;
+  u32 version;
+} SpotStreamHeader;
+
+
+typedef struct {
+  s32 pose;
+  u32 count;
+  u32 size; // of the spots, in bytes
+  u8 flags;
+  u8 nameLength;
+  u16 reserved;
+} SpotRecordHeader;
+
+
+typedef struct {
+  FILE *f;
+  bool packed;
+  u8 *bytes;
+  size_t capacity;
+} SpotStreamWriter;
+
+
+typedef struct {
+  FILE *f;
+  u8 *bytes;
+  size_t capacity;
+  char sweep[MAX_SPOT_SWEEP_NAME + 1];
+  s32 pose;
+} SpotStreamReader;
+
+
+// Writes the file header to f, which stays owned by the caller
+bool initSpotStreamWriter(SpotStreamWriter *w, FILE *f, bool packed);
+void freeSpotStreamWriter(SpotStreamWriter *w);
+
+bool writeSpotRecord(
+  SpotStreamWriter *w,
+  const char *sweep,
+  s32 pose,
+  const Spot *spots,
+  s32 count);
+
+// Reads the file header from f. Returns false, with f rewound, if f isn't a
+// spot stream.
+bool initSpotStreamReader(SpotStreamReader *r, FILE *f);
+void freeSpotStreamReader(SpotStreamReader *r);
+
+// Reads the next record's sweep and pose into r, and replaces the contents of
+// spots with its spots. Returns 1, 0 at the end of the file, or -1 if the
+// record is malformed.
+s32 readSpotRecord(SpotStreamReader *r, SpotBuffer *spots);
+
+
+#endif
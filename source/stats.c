@@ -0,0 +1,181 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include "stats.h"
+
+#include "util.h"
+
+#include <stdio.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef COLLISION_STATS
+#include <pthread.h>
+#endif
+
+
+f64 nowNs(void) {
+#ifdef WIN32
+  LARGE_INTEGER freq, counter;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&counter);
+  return (f64) counter.QuadPart * 1e9 / (f64) freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (f64) ts.tv_sec * 1e9 + (f64) ts.tv_nsec;
+#endif
+}
+
+
+#ifdef COLLISION_STATS
+
+__thread Stats threadStats;
+
+static Stats totalStats;
+static pthread_mutex_t totalStatsLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+void recordCellListLength(s32 length) {
+  if (length == 0) return;
+
+  STAT_INC(STAT_CELL_LISTS);
+  STAT_ADD(STAT_CELL_LIST_TRIS, length);
+  STAT_MAX(STAT_CELL_LIST_MAX, length);
+
+  if (length < 2) STAT_INC(STAT_CELL_LIST_LEN_1);
+  else if (length < 4) STAT_INC(STAT_CELL_LIST_LEN_2_3);
+  else if (length < 8) STAT_INC(STAT_CELL_LIST_LEN_4_7);
+  else if (length < 16) STAT_INC(STAT_CELL_LIST_LEN_8_15);
+  else if (length < 32) STAT_INC(STAT_CELL_LIST_LEN_16_31);
+  else STAT_INC(STAT_CELL_LIST_LEN_32_UP);
+}
+
+
+void mergeThreadStats(void) {
+  pthread_mutex_lock(&totalStatsLock);
+
+  for (s32 i = 0; i < NUM_STAT_COUNTERS; i++) {
+    u64 n = threadStats.counters[i];
+    if (i == STAT_CELL_LIST_MAX) {
+      if (n > totalStats.counters[i])
+        totalStats.counters[i] = n;
+    }
+    else {
+      totalStats.counters[i] += n;
+    }
+    threadStats.counters[i] = 0;
+  }
+
+  for (s32 i = 0; i < NUM_STAT_TIMERS; i++) {
+    totalStats.timersNs[i] += threadStats.timersNs[i];
+    threadStats.timersNs[i] = 0;
+  }
+
+  pthread_mutex_unlock(&totalStatsLock);
+}
+
+
+static f64 perQuery(StatCounter c, StatCounter queries) {
+  u64 n = totalStats.counters[queries];
+  return n > 0 ? (f64) totalStats.counters[c] / n : 0;
+}
+
+
+static f64 percentOf(StatCounter c, u64 total) {
+  return total > 0 ? 100.0 * totalStats.counters[c] / total : 0;
+}
+
+
+static void printQueryStats(
+  FILE *f,
+  const char *name,
+  StatCounter queries,
+  bool hasMisses,
+  StatCounter misses,
+  StatCounter dynamicTris,
+  StatCounter staticTris)
+{
+  u64 *c = totalStats.counters;
+  fprintf(f, "  %-13s %12llu queries", name, (unsigned long long) c[queries]);
+  if (hasMisses)
+    fprintf(f, ", %5.1f%% misses", percentOf(misses, c[queries]));
+  fprintf(f, ", tris/query %.2f dynamic + %.2f static\n",
+    perQuery(dynamicTris, queries), perQuery(staticTris, queries));
+}
+
+
+void printStats(FILE *f) {
+  mergeThreadStats();
+
+  pthread_mutex_lock(&totalStatsLock);
+  u64 *c = totalStats.counters;
+
+  fprintf(f, "Collision queries\n");
+  printQueryStats(f, "findFloor", STAT_FLOOR_QUERIES, true, STAT_FLOOR_MISSES,
+    STAT_FLOOR_DYNAMIC_TRIS, STAT_FLOOR_STATIC_TRIS);
+  printQueryStats(f, "findCeil", STAT_CEIL_QUERIES, true, STAT_CEIL_MISSES,
+    STAT_CEIL_DYNAMIC_TRIS, STAT_CEIL_STATIC_TRIS);
+  printQueryStats(f, "findWallCols", STAT_WALL_QUERIES, false, 0,
+    STAT_WALL_DYNAMIC_TRIS, STAT_WALL_STATIC_TRIS);
+
+  u64 floorCeilTris =
+    c[STAT_FLOOR_DYNAMIC_TRIS] + c[STAT_FLOOR_STATIC_TRIS] +
+    c[STAT_CEIL_DYNAMIC_TRIS] + c[STAT_CEIL_STATIC_TRIS];
+  fprintf(f, "Floor/ceiling triangle rejects (%% of tris visited)\n");
+  fprintf(f, "  edge 1 %.1f%%, edge 2 %.1f%%, edge 3 %.1f%%, "
+    "batched edges %.1f%%, height %.1f%%\n",
+    percentOf(STAT_EDGE1_REJECTS, floorCeilTris),
+    percentOf(STAT_EDGE2_REJECTS, floorCeilTris),
+    percentOf(STAT_EDGE3_REJECTS, floorCeilTris),
+    percentOf(STAT_BATCH_EDGE_REJECTS, floorCeilTris),
+    percentOf(STAT_HEIGHT_REJECTS, floorCeilTris));
+
+  // A wall that passes the y and offset tests either collides or fails an
+  // edge test
+  u64 wallTris = c[STAT_WALL_DYNAMIC_TRIS] + c[STAT_WALL_STATIC_TRIS];
+  u64 wallEdgeRejects = wallTris - c[STAT_WALL_Y_REJECTS] -
+    c[STAT_WALL_OFFSET_REJECTS] - c[STAT_WALL_COLLISIONS];
+  fprintf(f, "Wall triangle rejects (%% of tris visited)\n");
+  fprintf(f, "  y range %.1f%%, plane offset %.1f%%, edges %.1f%%, "
+    "collisions %.1f%%\n",
+    percentOf(STAT_WALL_Y_REJECTS, wallTris),
+    percentOf(STAT_WALL_OFFSET_REJECTS, wallTris),
+    wallTris > 0 ? 100.0 * wallEdgeRejects / wallTris : 0,
+    percentOf(STAT_WALL_COLLISIONS, wallTris));
+
+  u64 numLists = c[STAT_CELL_LISTS];
+  fprintf(f, "Compiled cell lists\n");
+  fprintf(f, "  %llu non-empty, mean length %.2f, max %llu\n",
+    (unsigned long long) numLists,
+    perQuery(STAT_CELL_LIST_TRIS, STAT_CELL_LISTS),
+    (unsigned long long) c[STAT_CELL_LIST_MAX]);
+  fprintf(f, "  length 1: %.1f%%, 2-3: %.1f%%, 4-7: %.1f%%, 8-15: %.1f%%, "
+    "16-31: %.1f%%, 32+: %.1f%%\n",
+    percentOf(STAT_CELL_LIST_LEN_1, numLists),
+    percentOf(STAT_CELL_LIST_LEN_2_3, numLists),
+    percentOf(STAT_CELL_LIST_LEN_4_7, numLists),
+    percentOf(STAT_CELL_LIST_LEN_8_15, numLists),
+    percentOf(STAT_CELL_LIST_LEN_16_31, numLists),
+    percentOf(STAT_CELL_LIST_LEN_32_UP, numLists));
+
+  fprintf(f, "Height maps\n");
+  fprintf(f, "  %llu rasterized, %llu points\n",
+    (unsigned long long) c[STAT_HEIGHT_MAPS],
+    (unsigned long long) c[STAT_HEIGHT_MAP_POINTS]);
+
+  f64 *t = totalStats.timersNs;
+  fprintf(f, "Phase times (summed over threads)\n");
+  fprintf(f, "  load model  %10.1f ms\n", t[STAT_TIME_LOAD_MODEL] / 1e6);
+  fprintf(f, "  compile     %10.1f ms\n", t[STAT_TIME_COMPILE] / 1e6);
+  fprintf(f, "  height maps %10.1f ms\n", t[STAT_TIME_HEIGHT_MAPS] / 1e6);
+  fprintf(f, "  search      %10.1f ms (including height maps)\n",
+    t[STAT_TIME_SEARCH] / 1e6);
+
+  pthread_mutex_unlock(&totalStatsLock);
+}
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef STATS_H
+#define STATS_H
+
+
+#include "util.h"
+
+#include <stdio.h>
+
+
+// Instrumentation counters and phase timers. They are compiled in only when
+// building with -DCOLLISION_STATS (e.g. ./build-batch.sh -DCOLLISION_STATS);
+// otherwise the STAT_ macros expand to nothing and cost nothing.
+//
+// Each thread counts into its own copy, which is added to the totals by
+// mergeThreadStats. Search workers merge when they finish, and printStats
+// merges the calling thread before printing.
+
+
+typedef enum {
+  STAT_FLOOR_QUERIES,
+  STAT_FLOOR_MISSES,
+  STAT_FLOOR_DYNAMIC_TRIS,
+  STAT_FLOOR_STATIC_TRIS,
+  STAT_CEIL_QUERIES,
+  STAT_CEIL_MISSES,
+  STAT_CEIL_DYNAMIC_TRIS,
+  STAT_CEIL_STATIC_TRIS,
+  STAT_WALL_QUERIES,
+  STAT_WALL_DYNAMIC_TRIS,
+  STAT_WALL_STATIC_TRIS,
+  STAT_WALL_COLLISIONS,
+
+  // Triangles visited by the current list walk, before they are moved to
+  // the counter for the query and partition with STAT_TAKE
+  STAT_TRIS,
+
+  // Why floor and ceiling tests rejected a triangle. The batched floor query
+  // tests the three edges at once, so its rejects are counted separately.
+  STAT_EDGE1_REJECTS,
+  STAT_EDGE2_REJECTS,
+  STAT_EDGE3_REJECTS,
+  STAT_BATCH_EDGE_REJECTS,
+  STAT_HEIGHT_REJECTS,
+
+  STAT_WALL_Y_REJECTS,
+  STAT_WALL_OFFSET_REJECTS,
+
+  // Lengths of the non-empty cell lists of every compiled world
+  STAT_CELL_LISTS,
+  STAT_CELL_LIST_TRIS,
+  STAT_CELL_LIST_MAX,
+  STAT_CELL_LIST_LEN_1,
+  STAT_CELL_LIST_LEN_2_3,
+  STAT_CELL_LIST_LEN_4_7,
+  STAT_CELL_LIST_LEN_8_15,
+  STAT_CELL_LIST_LEN_16_31,
+  STAT_CELL_LIST_LEN_32_UP,
+
+  STAT_HEIGHT_MAPS,
+  STAT_HEIGHT_MAP_POINTS,
+
+  NUM_STAT_COUNTERS
+} StatCounter;
+
+
+typedef enum {
+  STAT_TIME_LOAD_MODEL,
+  STAT_TIME_COMPILE,
+  STAT_TIME_HEIGHT_MAPS,
+  STAT_TIME_SEARCH,
+  NUM_STAT_TIMERS
+} StatTimer;
+
+
+// Monotonic time in nanoseconds
+f64 nowNs(void);
+
+
+#ifdef COLLISION_STATS
+
+typedef struct {
+  u64 counters[NUM_STAT_COUNTERS];
+  f64 timersNs[NUM_STAT_TIMERS];
+} Stats;
+
+extern __thread Stats threadStats;
+
+#define STAT_ADD(c, n) (threadStats.counters[c] += (n))
+#define STAT_INC(c) STAT_ADD(c, 1)
+#define STAT_MAX(c, n) \
+  (threadStats.counters[c] = \
+    (u64) (n) > threadStats.counters[c] ? (u64) (n) : threadStats.counters[c])
+#define STAT_TAKE(to, from) \
+  (threadStats.counters[to] += threadStats.counters[from], \
+    threadStats.counters[from] = 0)
+
+#define STAT_TIMER_START(t) f64 statStart_##t = nowNs()
+#define STAT_TIMER_STOP(t) \
+  (threadStats.timersNs[t] += nowNs() - statStart_##t)
+
+void recordCellListLength(s32 length);
+void mergeThreadStats(void);
+void printStats(FILE *f);
+
+#else
+
+#define STAT_ADD(c, n) ((void) 0)
+#define STAT_INC(c) ((void) 0)
+#define STAT_MAX(c, n) ((void) 0)
+#define STAT_TAKE(to, from) ((void) 0)
+#define STAT_TIMER_START(t) ((void) 0)
+#define STAT_TIMER_STOP(t) ((void) 0)
+
+static inline void recordCellListLength(s32 length) { (void) length; }
+static inline void mergeThreadStats(void) {}
+static inline void printStats(FILE *f) { (void) f; }
+
+#endif
+
+
+#endif
@@ -1,38 +1,132 @@
 #include "surface.h"
 
 #include "object.h"
+#include "stats.h"
 #include "util.h"
 
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+
+CollisionWorld defaultWorld;
+
+
+CollisionWorld *newCollisionWorld(void) {
+  CollisionWorld *world = (CollisionWorld *) malloc(sizeof(CollisionWorld));
+  if (world == NULL) return NULL;
+
+  world->surfaceNodesAllocated = 0;
+  world->surfacesAllocated = 0;
+  world->numStaticSurfaceNodes = 0;
+  world->numStaticSurfaces = 0;
+  world->surfaceNodeChunks = NULL;
+  world->surfaceChunks = NULL;
+  world->numSurfaceNodeChunks = 0;
+  world->numSurfaceChunks = 0;
+  world->vertexBuffer = NULL;
+  world->vertexBufferCapacity = 0;
+  memset(&world->compiled, 0, sizeof(CompiledPartitions));
+  worldInitStaticPartition(world);
+  worldInitDynamicPartition(world);
+  return world;
+}
+
+
+void freeCompiledPartitions(CompiledPartitions *c) {
+  free(c->x1);
+  free(c->y1);
+  free(c->z1);
+  free(c->x2);
+  free(c->y2);
+  free(c->z2);
+  free(c->x3);
+  free(c->y3);
+  free(c->z3);
+  free(c->nx);
+  free(c->ny);
+  free(c->nz);
+  free(c->originOffset);
+  free(c->lowerY);
+  free(c->upperY);
+  free(c->v04);
+  free(c->surfaces);
+  free(c->fineLists);
+  memset(c, 0, sizeof(CompiledPartitions));
+}
+
+
+void freeCollisionWorld(CollisionWorld *world) {
+  freeCompiledPartitions(&world->compiled);
+  for (s32 i = 0; i < world->numSurfaceNodeChunks; i++)
+    free(world->surfaceNodeChunks[i]);
+  for (s32 i = 0; i < world->numSurfaceChunks; i++)
+    free(world->surfaceChunks[i]);
+  free(world->surfaceNodeChunks);
+  free(world->surfaceChunks);
+  free(world->vertexBuffer);
+  free(world);
+}
+
 
+// Appends a chunk to a pool's chunk list
+static void *addPoolChunk(void ***chunks, s32 *numChunks, size_t chunkSize) {
+  void **grown =
+    (void **) realloc(*chunks, (*numChunks + 1) * sizeof(void *));
+  void *chunk = malloc(chunkSize);
+  if (grown == NULL || chunk == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  grown[*numChunks] = chunk;
+  *chunks = grown;
+  *numChunks += 1;
+  return chunk;
+}
 
-static SurfaceNode surfaceNodePoolI[7000];
-static Surface surfacePoolI[2300];
 
-SpatialPartitionCell staticPartition[16 * 16];
-SpatialPartitionCell dynamicPartition[16 * 16];
+// Makes sure the pools can hold numNodes nodes and numSurfaces surfaces
+static void reservePools(
+  CollisionWorld *world, s32 numNodes, s32 numSurfaces)
+{
+  while (world->numSurfaceNodeChunks * SURFACE_NODE_POOL_CHUNK < numNodes) {
+    addPoolChunk((void ***) &world->surfaceNodeChunks,
+      &world->numSurfaceNodeChunks,
+      SURFACE_NODE_POOL_CHUNK * sizeof(SurfaceNode));
+  }
+  while (world->numSurfaceChunks * SURFACE_POOL_CHUNK < numSurfaces) {
+    addPoolChunk((void ***) &world->surfaceChunks, &world->numSurfaceChunks,
+      SURFACE_POOL_CHUNK * sizeof(Surface));
+  }
+}
 
-SurfaceNode *surfaceNodePool = &surfaceNodePoolI;
-Surface *surfacePool = &surfacePoolI;
 
-s32 surfaceNodesAllocated;
-s32 surfacesAllocated;
-s32 numStaticSurfaceNodes;
-s32 numStaticSurfaces;
+static SurfaceNode *worldSurfaceNode(CollisionWorld *world, s32 i) {
+  return &world->surfaceNodeChunks[i / SURFACE_NODE_POOL_CHUNK]
+    [i % SURFACE_NODE_POOL_CHUNK];
+}
 
 
 /** 80382490(J) */
-SurfaceNode *allocSurfaceNode(void) {
-  SurfaceNode *node = &surfaceNodePool[surfaceNodesAllocated++];
+SurfaceNode *allocSurfaceNode(CollisionWorld *world) {
+  s32 i = world->surfaceNodesAllocated++;
+  if (i % SURFACE_NODE_POOL_CHUNK == 0)
+    reservePools(world, i + 1, 0);
+
+  SurfaceNode *node = worldSurfaceNode(world, i);
   node->tail = NULL;
   return node;
 }
 
 
 /** 803824F8(J) */
-Surface *allocSurface(void) {
-  Surface *tri = &surfacePool[surfacesAllocated++];
+Surface *worldAllocSurface(CollisionWorld *world) {
+  s32 i = world->surfacesAllocated++;
+  if (i % SURFACE_POOL_CHUNK == 0)
+    reservePools(world, 0, i + 1);
+
+  Surface *tri = worldSurface(world, i);
   tri->type = 0;
   tri->v02 = 0;
   tri->v04 = 0;
@@ -42,6 +136,11 @@ Surface *allocSurface(void) {
 }
 
 
+Surface *allocSurface(void) {
+  return worldAllocSurface(&defaultWorld);
+}
+
+
 /** 80382590(J) */
 void initSpatialPartition(SpatialPartitionCell *partition) {
   for (s32 i = 0; i < 16 * 16; i++) {
@@ -53,16 +152,22 @@ void initSpatialPartition(SpatialPartitionCell *partition) {
 
 
 /** 803825D0(J) */
+void worldInitStaticPartition(CollisionWorld *world) {
+  world->compiled.valid = false;
+  initSpatialPartition(world->staticPartition);
+}
+
+
 void initStaticPartition(void) {
-  initSpatialPartition(&staticPartition);
+  worldInitStaticPartition(&defaultWorld);
 }
 
 
 /** 803825FC(J) */
 void addSurfaceToPartition(
-  bool dynamic, s16 xidx, s16 zidx, Surface *tri)
+  CollisionWorld *world, bool dynamic, s16 xidx, s16 zidx, Surface *tri)
 {
-  SurfaceNode *newNode = allocSurfaceNode();
+  SurfaceNode *newNode = allocSurfaceNode(world);
 
   s16 listIdx;
   s16 sortDir;
@@ -89,9 +194,9 @@ void addSurfaceToPartition(
   
   SurfaceNode *list;
   if (dynamic)
-    list = &dynamicPartition[16 * zidx + xidx].lists[listIdx];
+    list = &world->dynamicPartition[16 * zidx + xidx].lists[listIdx];
   else
-    list = &staticPartition[16 * zidx + xidx].lists[listIdx];
+    list = &world->staticPartition[16 * zidx + xidx].lists[listIdx];
 
   while (list->tail != NULL) {
     s16 priority = list->tail->head->vertex1.y * sortDir;
@@ -141,7 +246,9 @@ s16 upperPartitionCellIdx(s16 t) {
 
 
 /** 80382A2C(J) */
-void addSurface(Surface *tri, bool dynamic) {
+void worldAddSurface(CollisionWorld *world, Surface *tri, bool dynamic) {
+  world->compiled.valid = false;
+
   s16 minX = min3(tri->vertex1.x, tri->vertex2.x, tri->vertex3.x);
   s16 minZ = min3(tri->vertex1.z, tri->vertex2.z, tri->vertex3.z);
   s16 maxX = max3(tri->vertex1.x, tri->vertex2.x, tri->vertex3.x);
@@ -154,12 +261,22 @@ void addSurface(Surface *tri, bool dynamic) {
 
   for (s16 zidx = zidx0; zidx <= zidx1; zidx++)
     for (s16 xidx = xidx0; xidx <= xidx1; xidx++)
-      addSurfaceToPartition(dynamic, xidx, zidx, tri);
+      addSurfaceToPartition(world, dynamic, xidx, zidx, tri);
+}
+
+
+void addSurface(Surface *tri, bool dynamic) {
+  worldAddSurface(&defaultWorld, tri, dynamic);
 }
 
 
+// Writes the surface to tri, or to a newly allocated one if tri is NULL. The
+// incremental model update passes its own storage. Returns NULL for
+// degenerate triangles, which the game skips.
 /** 80382B7C(J) */
-Surface *readSurfaceData(s16 *vertexData, s16 **indices) {
+static Surface *readSurfaceData(
+  CollisionWorld *world, s16 *vertexData, s16 **indices, Surface *tri)
+{
   s16 offset1 = 3 * *(*indices + 0);
   s16 offset2 = 3 * *(*indices + 1);
   s16 offset3 = 3 * *(*indices + 2);
@@ -196,7 +313,8 @@ Surface *readSurfaceData(s16 *vertexData, s16 **indices) {
   ny *= mag;
   nz *= mag;
 
-  Surface *tri = allocSurface();
+  if (tri == NULL)
+    tri = worldAllocSurface(world);
   
   tri->vertex1.x = x1;
   tri->vertex1.y = y1;
@@ -223,13 +341,48 @@ Surface *readSurfaceData(s16 *vertexData, s16 **indices) {
 }
 
 
+/** 80382F84(J) */
+bool surfaceHasForce(s16 surfaceType) {
+  switch (surfaceType) {
+  case 0x0004:
+  case 0x000E:
+  case 0x0024:
+  case 0x0025:
+  case 0x0027:
+  case 0x002C:
+  case 0x002D:
+    return true;
+  default:
+    return false;
+  }
+}
+
+
+/** 80382FEC(J) */
+s8 surfaceNoCamCollisionFlags(s16 surfaceType) {
+  switch (surfaceType) {
+  case 0x0076:
+  case 0x0077:
+  case 0x0078:
+  case 0x007A:
+    return 0x02;
+  default:
+    return 0;
+  }
+}
+
+
 /** 80383068(J) */
 void readStaticSurfaces(
-  s16 **data, s16 *vertexData, s16 surfaceType, s8 **arg3)
+  CollisionWorld *world,
+  s16 **data,
+  s16 *vertexData,
+  s16 surfaceType,
+  s8 **arg3)
 {
   u8 valB = 0;
-  u16 val8 = 0; //p80382F84(surfaceType);
-  u16 val6 = 0; //p80382FEC(surfaceType);
+  u16 val8 = surfaceHasForce(surfaceType);
+  u16 val6 = surfaceNoCamCollisionFlags(surfaceType);
   
   s32 numTris = *(*data)++;
 
@@ -237,7 +390,7 @@ void readStaticSurfaces(
     if (*arg3 != NULL)
       valB = *(*arg3)++;
 
-    Surface *tri = readSurfaceData(vertexData, data);
+    Surface *tri = readSurfaceData(world, vertexData, data, NULL);
     if (tri != NULL) {
       tri->v05 = valB;
       tri->type = surfaceType;
@@ -248,7 +401,7 @@ void readStaticSurfaces(
       else
         tri->v02 = 0;
 
-      addSurface(tri, false);
+      worldAddSurface(world, tri, false);
     }
 
     *data += 3;
@@ -267,11 +420,114 @@ s16 *readVertexData(s16 **data) {
 }
 
 
+// The surface loading part of the game's area terrain loader. data is a
+// level collision stream in the game's format: vertex lists (0x40) and
+// surface groups, then 0x41. Special objects (0x43) and environment regions
+// (0x44) come after the surfaces and aren't loaded, so loading stops at any
+// of 0x42-0x44. The stream must already be validated (see level.h).
+void worldLoadStaticSurfaces(CollisionWorld *world, s16 *data) {
+  s16 *vertexData = NULL;
+  s8 *surfaceRooms = NULL;
+
+  world->surfacesAllocated = 0;
+  world->surfaceNodesAllocated = 0;
+  worldInitStaticPartition(world);
+
+  while (true) {
+    s16 command = *data++;
+
+    if (command < 0x40 || command >= 0x65)
+      readStaticSurfaces(world, &data, vertexData, command, &surfaceRooms);
+    else if (command == 0x40)
+      vertexData = readVertexData(&data);
+    else if (command != 0x41)
+      break;
+  }
+
+  world->numStaticSurfaceNodes = world->surfaceNodesAllocated;
+  world->numStaticSurfaces = world->surfacesAllocated;
+  worldInitDynamicPartition(world);
+}
+
+
+// Index of a pool entry given its address. Pools have few chunks, so they
+// are searched in order.
+static s32 surfaceNodeIndex(CollisionWorld *world, SurfaceNode *node) {
+  for (s32 c = 0; c < world->numSurfaceNodeChunks; c++) {
+    SurfaceNode *chunk = world->surfaceNodeChunks[c];
+    if (node >= chunk && node < chunk + SURFACE_NODE_POOL_CHUNK)
+      return c * SURFACE_NODE_POOL_CHUNK + (s32) (node - chunk);
+  }
+  return -1;
+}
+
+
+s32 worldSurfaceIndex(CollisionWorld *world, Surface *s) {
+  for (s32 c = 0; c < world->numSurfaceChunks; c++) {
+    Surface *chunk = world->surfaceChunks[c];
+    if (s >= chunk && s < chunk + SURFACE_POOL_CHUNK)
+      return c * SURFACE_POOL_CHUNK + (s32) (s - chunk);
+  }
+  return -1;
+}
+
+
+static SurfaceNode *rebaseNode(
+  CollisionWorld *world, CollisionWorld *src, SurfaceNode *node)
+{
+  if (node == NULL) return NULL;
+  return worldSurfaceNode(world, surfaceNodeIndex(src, node));
+}
+
+
+// Replaces the static surfaces of world with a copy of those in src, e.g. a
+// level loaded once by worldLoadStaticSurfaces. Since the static surfaces and
+// nodes are a prefix of the pools, this is a copy plus pointer fixups rather
+// than a reload. Dynamic surfaces in world are cleared.
+void worldCopyStaticSurfaces(CollisionWorld *world, CollisionWorld *src) {
+  s32 numSurfaces = src->numStaticSurfaces;
+  s32 numNodes = src->numStaticSurfaceNodes;
+  reservePools(world, numNodes, numSurfaces);
+
+  for (s32 i = 0; i < numSurfaces; i += SURFACE_POOL_CHUNK) {
+    s32 n = numSurfaces - i;
+    if (n > SURFACE_POOL_CHUNK) n = SURFACE_POOL_CHUNK;
+    memcpy(worldSurface(world, i), worldSurface(src, i), n * sizeof(Surface));
+  }
+
+  for (s32 i = 0; i < numNodes; i++) {
+    SurfaceNode *node = worldSurfaceNode(src, i);
+    worldSurfaceNode(world, i)->tail = rebaseNode(world, src, node->tail);
+    worldSurfaceNode(world, i)->head =
+      worldSurface(world, worldSurfaceIndex(src, node->head));
+  }
+
+  for (s32 cell = 0; cell < 16 * 16; cell++) {
+    for (s32 j = 0; j < 3; j++) {
+      world->staticPartition[cell].lists[j].tail =
+        rebaseNode(world, src, src->staticPartition[cell].lists[j].tail);
+    }
+  }
+
+  world->numStaticSurfaces = numSurfaces;
+  world->numStaticSurfaceNodes = numNodes;
+  world->compiled.valid = false;
+  worldInitDynamicPartition(world);
+}
+
+
 /** 803835A4(J) */
+void worldInitDynamicPartition(CollisionWorld *world) {
+  world->surfacesAllocated = world->numStaticSurfaces;
+  world->surfaceNodesAllocated = world->numStaticSurfaceNodes;
+  world->freeSurfaceNodes = NULL;
+  world->compiled.valid = false;
+  initSpatialPartition(world->dynamicPartition);
+}
+
+
 void initDynamicPartition(void) {
-  surfacesAllocated = numStaticSurfaces;
-  surfaceNodesAllocated = numStaticSurfaceNodes;
-  initSpatialPartition(&dynamicPartition);
+  worldInitDynamicPartition(&defaultWorld);
 }
 
 
@@ -317,28 +573,21 @@ void readObjectCollisionVertices(Object *curObj, s16 **data, s16 *vertexData) {
 
   Mtxf m;
   applyObjectScale(curObj, &m, transform);
-  
-  while (numVerts-- != 0) {
-    s16 vx = *(*data)++;
-    s16 vy = *(*data)++;
-    s16 vz = *(*data)++;
 
-    *vertexData++ = (s16) (m[0][0]*vx + m[1][0]*vy + m[2][0]*vz + m[3][0]);
-    *vertexData++ = (s16) (m[0][1]*vx + m[1][1]*vy + m[2][1]*vz + m[3][1]);
-    *vertexData++ = (s16) (m[0][2]*vx + m[1][2]*vy + m[2][2]*vz + m[3][2]);
-  }
+  transformVertices(m, *data, vertexData, numVerts);
+  *data += 3 * numVerts;
 }
 
 
 /** 80383828(J) */
 void loadObjColModelFromVertexData(
-  Object *curObj, s16 **data, s16 *vertexData)
+  CollisionWorld *world, Object *curObj, s16 **data, s16 *vertexData)
 {
   s16 surfaceType = *(*data)++;
   s32 numTris = *(*data)++;
 
-  u16 valA = 0; //p80382F84(surfaceType);
-  u16 val8 = 0; //p80382FEC(surfaceType);
+  u16 valA = surfaceHasForce(surfaceType);
+  u16 val8 = surfaceNoCamCollisionFlags(surfaceType);
   val8 |= 0x0001;
 
   u16 val6;
@@ -348,7 +597,7 @@ void loadObjColModelFromVertexData(
     val6 = 0;
 
   for (s32 i = 0; i < numTris; i++) {
-    Surface *tri = readSurfaceData(vertexData, data);
+    Surface *tri = readSurfaceData(world, vertexData, data, NULL);
 
     if (tri != NULL) {
       tri->object = curObj;
@@ -361,7 +610,7 @@ void loadObjColModelFromVertexData(
       
       tri->v04 |= (s8) val8;
       tri->v05 = (s8) val6;
-      addSurface(tri, true);
+      worldAddSurface(world, tri, true);
     }
 
     if (valA != 0)
@@ -372,9 +621,26 @@ void loadObjColModelFromVertexData(
 }
 
 
+// The game transforms into a fixed 600 entry buffer on the stack. Here the
+// buffer belongs to the world and is sized by the model's vertex count.
+static s16 *getVertexBuffer(CollisionWorld *world, s16 *model) {
+  s32 numVerts = model[1];
+  if (numVerts > world->vertexBufferCapacity) {
+    free(world->vertexBuffer);
+    world->vertexBuffer = (s16 *) malloc(3 * numVerts * sizeof(s16));
+    if (world->vertexBuffer == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+    world->vertexBufferCapacity = numVerts;
+  }
+  return world->vertexBuffer;
+}
+
+
 /** 803839CC(J) */
-void loadObjectCollisionModel(Object *curObj) {
-  s16 vertexData[600];
+void worldLoadObjectCollisionModel(CollisionWorld *world, Object *curObj) {
+  s16 *vertexData = getVertexBuffer(world, curObj->collisionModel);
 
   s16 *val8 = curObj->collisionModel;
   // f32 marioDist = curObj->distToMario;
@@ -390,10 +656,10 @@ void loadObjectCollisionModel(Object *curObj) {
   //   !(curObj->v074 & 0x0008))
   {
     val8++;
-    readObjectCollisionVertices(curObj, &val8, &vertexData);
+    readObjectCollisionVertices(curObj, &val8, vertexData);
 
     while (*val8 != 0x41) {
-      loadObjColModelFromVertexData(curObj, &val8, &vertexData);
+      loadObjColModelFromVertexData(world, curObj, &val8, vertexData);
     }
   }
 
@@ -404,6 +670,514 @@ void loadObjectCollisionModel(Object *curObj) {
 }
 
 
+void loadObjectCollisionModel(Object *curObj) {
+  worldLoadObjectCollisionModel(&defaultWorld, curObj);
+}
+
+
+// Rebuilds the dynamic partition from several objects, loaded in order as
+// the game does each frame
+void worldLoadObjectCollisionModels(
+  CollisionWorld *world, Object *objects, s32 numObjects)
+{
+  worldInitDynamicPartition(world);
+  for (s32 i = 0; i < numObjects; i++)
+    worldLoadObjectCollisionModel(world, &objects[i]);
+}
+
+
+// Incremental alternative to reloading an object's collision model. The lists
+// produced by addSurfaceToPartition are sorted by priority (vertex1.y times
+// the sort direction), with ties in insertion order, i.e. surface pool order.
+// So after the surfaces are rewritten in place, the lists match a full rebuild
+// as long as every surface whose cells, list or priority changed is removed
+// and reinserted at its sorted position. Ties compare pool indices, since the
+// pool's chunks are separate allocations whose addresses can't be ordered.
+// Nodes freed this way are kept on a free list until the dynamic partition is
+// reset.
+
+
+static s32 countModelTris(s16 *data) {
+  s32 count = 0;
+
+  data++;
+  s16 numVerts = *data++;
+  data += 3 * numVerts;
+
+  while (*data != 0x41) {
+    s16 surfaceType = *data++;
+    s32 numTris = *data++;
+    count += numTris;
+    data += (surfaceHasForce(surfaceType) ? 4 : 3) * numTris;
+  }
+
+  return count;
+}
+
+
+typedef struct {
+  s16 listIdx;
+  s16 priority;
+  s16 xidx0;
+  s16 xidx1;
+  s16 zidx0;
+  s16 zidx1;
+} SurfacePlacement;
+
+
+static SurfacePlacement getSurfacePlacement(Surface *tri) {
+  SurfacePlacement p;
+  s16 sortDir;
+
+  if (tri->normal.y > 0.01) {
+    p.listIdx = 0;
+    sortDir = 1;
+  }
+  else if (tri->normal.y < -0.01) {
+    p.listIdx = 1;
+    sortDir = -1;
+  }
+  else {
+    p.listIdx = 2;
+    sortDir = 0;
+  }
+  p.priority = tri->vertex1.y * sortDir;
+
+  s16 minX = min3(tri->vertex1.x, tri->vertex2.x, tri->vertex3.x);
+  s16 minZ = min3(tri->vertex1.z, tri->vertex2.z, tri->vertex3.z);
+  s16 maxX = max3(tri->vertex1.x, tri->vertex2.x, tri->vertex3.x);
+  s16 maxZ = max3(tri->vertex1.z, tri->vertex2.z, tri->vertex3.z);
+
+  p.xidx0 = lowerPartitionCellIdx(minX);
+  p.xidx1 = upperPartitionCellIdx(maxX);
+  p.zidx0 = lowerPartitionCellIdx(minZ);
+  p.zidx1 = upperPartitionCellIdx(maxZ);
+
+  return p;
+}
+
+
+static bool samePlacement(SurfacePlacement *a, SurfacePlacement *b) {
+  return a->listIdx == b->listIdx && a->priority == b->priority &&
+    a->xidx0 == b->xidx0 && a->xidx1 == b->xidx1 &&
+    a->zidx0 == b->zidx0 && a->zidx1 == b->zidx1;
+}
+
+
+static void removeFromDynamicPartition(
+  CollisionWorld *world, Surface *tri, SurfacePlacement *p)
+{
+  for (s16 zidx = p->zidx0; zidx <= p->zidx1; zidx++) {
+    for (s16 xidx = p->xidx0; xidx <= p->xidx1; xidx++) {
+      SurfaceNode *list =
+        &world->dynamicPartition[16 * zidx + xidx].lists[p->listIdx];
+
+      while (list->tail != NULL && list->tail->head != tri)
+        list = list->tail;
+
+      if (list->tail != NULL) {
+        SurfaceNode *node = list->tail;
+        list->tail = node->tail;
+        node->tail = world->freeSurfaceNodes;
+        world->freeSurfaceNodes = node;
+      }
+    }
+  }
+}
+
+
+static void insertIntoDynamicPartition(
+  CollisionWorld *world, Surface *tri, SurfacePlacement *p)
+{
+  s16 sortDir = p->listIdx == 0 ? 1 : p->listIdx == 1 ? -1 : 0;
+  s32 triIdx = worldSurfaceIndex(world, tri);
+
+  for (s16 zidx = p->zidx0; zidx <= p->zidx1; zidx++) {
+    for (s16 xidx = p->xidx0; xidx <= p->xidx1; xidx++) {
+      SurfaceNode *node = world->freeSurfaceNodes;
+      if (node != NULL)
+        world->freeSurfaceNodes = node->tail;
+      else
+        node = allocSurfaceNode(world);
+      node->head = tri;
+
+      SurfaceNode *list =
+        &world->dynamicPartition[16 * zidx + xidx].lists[p->listIdx];
+
+      // Skip higher priorities, and equal priorities from earlier surfaces
+      while (list->tail != NULL) {
+        Surface *other = list->tail->head;
+        s16 priority = other->vertex1.y * sortDir;
+        if (p->priority > priority) break;
+        if (p->priority == priority &&
+          worldSurfaceIndex(world, other) > triIdx)
+        {
+          break;
+        }
+        list = list->tail;
+      }
+
+      node->tail = list->tail;
+      list->tail = node;
+    }
+  }
+}
+
+
+// Equivalent to worldInitDynamicPartition followed by
+// worldLoadObjectCollisionModel, provided the dynamic partition currently
+// holds only curObj's model from an earlier load. Otherwise (or if a triangle
+// is degenerate in the new pose) it falls back to exactly that.
+void worldUpdateObjectCollisionModel(CollisionWorld *world, Object *curObj) {
+  s32 numTris = countModelTris(curObj->collisionModel);
+  s32 first = world->numStaticSurfaces;
+
+  bool loaded =
+    numTris > 0 &&
+    world->surfacesAllocated - world->numStaticSurfaces == numTris &&
+    worldSurface(world, first)->object == curObj;
+
+  if (!loaded) {
+    worldInitDynamicPartition(world);
+    worldLoadObjectCollisionModel(world, curObj);
+    return;
+  }
+
+  Surface *next = (Surface *) malloc(numTris * sizeof(Surface));
+  SurfacePlacement *moved =
+    (SurfacePlacement *) malloc(numTris * sizeof(SurfacePlacement));
+  if (next == NULL || moved == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  s16 *vertexData = getVertexBuffer(world, curObj->collisionModel);
+  s16 *data = curObj->collisionModel;
+  data++;
+  readObjectCollisionVertices(curObj, &data, vertexData);
+
+  bool degenerate = false;
+  s32 k = 0;
+  while (!degenerate && *data != 0x41) {
+    s16 surfaceType = *data++;
+    s32 groupTris = *data++;
+    bool hasForce = surfaceHasForce(surfaceType);
+    s8 flags = surfaceNoCamCollisionFlags(surfaceType) | 0x01;
+
+    for (s32 i = 0; i < groupTris; i++, k++) {
+      if (readSurfaceData(world, vertexData, &data, &next[k]) == NULL) {
+        degenerate = true;
+        break;
+      }
+      next[k].type = surfaceType;
+      next[k].v02 = hasForce ? *(data + 3) : 0;
+      next[k].v04 = flags;
+      next[k].v05 = 0;
+      next[k].object = curObj;
+      data += hasForce ? 4 : 3;
+    }
+  }
+
+  if (degenerate) {
+    free(next);
+    free(moved);
+    worldInitDynamicPartition(world);
+    worldLoadObjectCollisionModel(world, curObj);
+    return;
+  }
+
+  s32 numMoved = 0;
+  for (k = 0; k < numTris; k++) {
+    Surface *tri = worldSurface(world, first + k);
+    SurfacePlacement oldPlacement = getSurfacePlacement(tri);
+    SurfacePlacement newPlacement = getSurfacePlacement(&next[k]);
+
+    if (newPlacement.listIdx == 2 &&
+      (next[k].normal.x < -0.707 || next[k].normal.x > 0.707))
+    {
+      next[k].v04 |= 0x08;
+    }
+
+    if (!samePlacement(&oldPlacement, &newPlacement)) {
+      removeFromDynamicPartition(world, tri, &oldPlacement);
+      moved[k] = newPlacement;
+      numMoved += 1;
+    }
+    else {
+      moved[k].listIdx = -1;
+    }
+  }
+
+  // Insertion compares against the priorities of the surfaces already in the
+  // lists, so every surface is rewritten first
+  for (k = 0; k < numTris; k++)
+    *worldSurface(world, first + k) = next[k];
+
+  for (k = 0; k < numTris && numMoved > 0; k++) {
+    if (moved[k].listIdx >= 0) {
+      insertIntoDynamicPartition(
+        world, worldSurface(world, first + k), &moved[k]);
+      numMoved -= 1;
+    }
+  }
+
+  world->compiled.valid = false;
+  free(next);
+  free(moved);
+}
+
+
+void updateObjectCollisionModel(Object *curObj) {
+  worldUpdateObjectCollisionModel(&defaultWorld, curObj);
+}
+
+
+static void *allocCompiledArray(void *p, s32 count, size_t size) {
+  free(p);
+  void *result = malloc(count * size);
+  if (result == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  return result;
+}
+
+
+static void growCompiledPartitions(CompiledPartitions *c, s32 capacity) {
+  c->x1 = (s32 *) allocCompiledArray(c->x1, capacity, sizeof(s32));
+  c->y1 = (s32 *) allocCompiledArray(c->y1, capacity, sizeof(s32));
+  c->z1 = (s32 *) allocCompiledArray(c->z1, capacity, sizeof(s32));
+  c->x2 = (s32 *) allocCompiledArray(c->x2, capacity, sizeof(s32));
+  c->y2 = (s32 *) allocCompiledArray(c->y2, capacity, sizeof(s32));
+  c->z2 = (s32 *) allocCompiledArray(c->z2, capacity, sizeof(s32));
+  c->x3 = (s32 *) allocCompiledArray(c->x3, capacity, sizeof(s32));
+  c->y3 = (s32 *) allocCompiledArray(c->y3, capacity, sizeof(s32));
+  c->z3 = (s32 *) allocCompiledArray(c->z3, capacity, sizeof(s32));
+  c->nx = (f32 *) allocCompiledArray(c->nx, capacity, sizeof(f32));
+  c->ny = (f32 *) allocCompiledArray(c->ny, capacity, sizeof(f32));
+  c->nz = (f32 *) allocCompiledArray(c->nz, capacity, sizeof(f32));
+  c->originOffset =
+    (f32 *) allocCompiledArray(c->originOffset, capacity, sizeof(f32));
+  c->lowerY = (s16 *) allocCompiledArray(c->lowerY, capacity, sizeof(s16));
+  c->upperY = (s16 *) allocCompiledArray(c->upperY, capacity, sizeof(s16));
+  c->v04 = (s8 *) allocCompiledArray(c->v04, capacity, sizeof(s8));
+  c->surfaces =
+    (Surface **) allocCompiledArray(c->surfaces, capacity, sizeof(Surface *));
+  c->capacity = capacity;
+}
+
+
+static void compileEntry(CompiledPartitions *c, Surface *tri, s32 i) {
+  c->x1[i] = tri->vertex1.x;
+  c->y1[i] = tri->vertex1.y;
+  c->z1[i] = tri->vertex1.z;
+  c->x2[i] = tri->vertex2.x;
+  c->y2[i] = tri->vertex2.y;
+  c->z2[i] = tri->vertex2.z;
+  c->x3[i] = tri->vertex3.x;
+  c->y3[i] = tri->vertex3.y;
+  c->z3[i] = tri->vertex3.z;
+  c->nx[i] = tri->normal.x;
+  c->ny[i] = tri->normal.y;
+  c->nz[i] = tri->normal.z;
+  c->originOffset[i] = tri->originOffset;
+  c->lowerY[i] = tri->lowerY;
+  c->upperY[i] = tri->upperY;
+  c->v04[i] = tri->v04;
+  c->surfaces[i] = tri;
+}
+
+
+static s32 compileList(CompiledPartitions *c, SurfaceNode *node, s32 i) {
+  for (; node != NULL; node = node->tail, i++)
+    compileEntry(c, node->head, i);
+  return i;
+}
+
+
+static s32 compilePartition(
+  CompiledPartitions *c,
+  SpatialPartitionCell *partition,
+  CompiledList (*lists)[3],
+  s32 i)
+{
+  for (s32 cell = 0; cell < 16 * 16; cell++) {
+    for (s32 j = 0; j < 3; j++) {
+      lists[cell][j].start = i;
+      i = compileList(c, partition[cell].lists[j].tail, i);
+      lists[cell][j].count = i - lists[cell][j].start;
+      recordCellListLength(lists[cell][j].count);
+    }
+  }
+  return i;
+}
+
+
+static bool outsideS16Half(s16 v) {
+  return v < -0x4000 || v > 0x4000;
+}
+
+
+// Whether a point in the given subcell can pass the floor/ceiling edge tests
+// for tri. A point that passes all three is inside the triangle, so inside its
+// bounding box, unless the edge functions can overflow or the triangle is
+// degenerate in xz. Those triangles are kept in every subcell.
+static bool subcellMayHit(Surface *tri, s32 cell, s32 sub) {
+  v3h *v1 = &tri->vertex1;
+  v3h *v2 = &tri->vertex2;
+  v3h *v3 = &tri->vertex3;
+
+  if (outsideS16Half(v1->x) || outsideS16Half(v1->z) ||
+    outsideS16Half(v2->x) || outsideS16Half(v2->z) ||
+    outsideS16Half(v3->x) || outsideS16Half(v3->z))
+  {
+    return true;
+  }
+
+  s64 area = (s64) (v2->x - v1->x) * (v3->z - v1->z) -
+    (s64) (v2->z - v1->z) * (v3->x - v1->x);
+  if (area == 0) return true;
+
+  s32 minX = v1->x, maxX = v1->x;
+  s32 minZ = v1->z, maxZ = v1->z;
+  if (v2->x < minX) minX = v2->x;
+  if (v2->x > maxX) maxX = v2->x;
+  if (v3->x < minX) minX = v3->x;
+  if (v3->x > maxX) maxX = v3->x;
+  if (v2->z < minZ) minZ = v2->z;
+  if (v2->z > maxZ) maxZ = v2->z;
+  if (v3->z < minZ) minZ = v3->z;
+  if (v3->z > maxZ) maxZ = v3->z;
+
+  // Integer points x0 <= x < x0 + FINE_GRID_SIZE, and the same for z
+  s32 x0 = (cell % 16) * 0x400 - 0x2000;
+  s32 z0 = (cell / 16) * 0x400 - 0x2000;
+  x0 += (sub % FINE_GRID_DIV) * FINE_GRID_SIZE;
+  z0 += (sub / FINE_GRID_DIV) * FINE_GRID_SIZE;
+
+  return minX < x0 + FINE_GRID_SIZE && maxX >= x0 &&
+    minZ < z0 + FINE_GRID_SIZE && maxZ >= z0;
+}
+
+
+static s32 listLength(SurfaceNode *node) {
+  s32 count = 0;
+  for (; node != NULL; node = node->tail)
+    count++;
+  return count;
+}
+
+
+// Splits the long floor and ceiling lists of a partition, either counting the
+// entries and subcell lists needed (fine == NULL) or compiling them from
+// entry i
+static s32 refinePartition(
+  CompiledPartitions *c,
+  SpatialPartitionCell *partition,
+  s32 (*fine)[2],
+  s32 i,
+  s32 *numFineLists)
+{
+  for (s32 cell = 0; cell < 16 * 16; cell++) {
+    for (s32 j = 0; j < 2; j++) {
+      SurfaceNode *head = partition[cell].lists[j].tail;
+
+      if (fine != NULL) fine[cell][j] = -1;
+      if (listLength(head) <= FINE_GRID_MIN_LIST) continue;
+      if (fine != NULL) fine[cell][j] = *numFineLists;
+
+      for (s32 sub = 0; sub < FINE_GRID_DIV * FINE_GRID_DIV; sub++) {
+        s32 start = i;
+        for (SurfaceNode *node = head; node != NULL; node = node->tail) {
+          if (subcellMayHit(node->head, cell, sub)) {
+            if (fine != NULL) compileEntry(c, node->head, i);
+            i += 1;
+          }
+        }
+
+        if (fine != NULL) {
+          c->fineLists[*numFineLists].start = start;
+          c->fineLists[*numFineLists].count = i - start;
+        }
+        *numFineLists += 1;
+      }
+    }
+  }
+  return i;
+}
+
+
+void worldCompilePartitions(CollisionWorld *world) {
+  CompiledPartitions *c = &world->compiled;
+
+  // Each node in a list is one entry. Nodes on the free list are counted
+  // too, so this is an upper bound.
+  s32 numEntries = world->surfaceNodesAllocated;
+
+  // Subcell lists are copies, appended after the cell lists
+  s32 numFineLists = 0;
+  if (c->fineGrid) {
+    numEntries = refinePartition(
+      c, world->staticPartition, NULL, numEntries, &numFineLists);
+    numEntries = refinePartition(
+      c, world->dynamicPartition, NULL, numEntries, &numFineLists);
+
+    if (numFineLists > c->fineListsCapacity) {
+      c->fineLists = (CompiledList *) allocCompiledArray(
+        c->fineLists, numFineLists, sizeof(CompiledList));
+      c->fineListsCapacity = numFineLists;
+    }
+  }
+
+  if (numEntries > c->capacity) {
+    s32 capacity = c->capacity > 0 ? c->capacity : 256;
+    while (capacity < numEntries)
+      capacity *= 2;
+    growCompiledPartitions(c, capacity);
+  }
+
+  s32 i = compilePartition(c, world->staticPartition, c->staticLists, 0);
+  i = compilePartition(c, world->dynamicPartition, c->dynamicLists, i);
+
+  if (c->fineGrid) {
+    numFineLists = 0;
+    i = refinePartition(
+      c, world->staticPartition, c->staticFine, i, &numFineLists);
+    refinePartition(
+      c, world->dynamicPartition, c->dynamicFine, i, &numFineLists);
+  }
+
+  c->valid = true;
+}
+
+
+// Splitting is only used by worlds that ask for it, so the default world
+// always walks the game's 16x16 cell lists. The subcell lists keep the order
+// of the cell lists, so queries return the same triangle either way.
+void worldSetFineGrid(CollisionWorld *world, bool enabled) {
+  world->compiled.fineGrid = enabled;
+  world->compiled.valid = false;
+}
+
+
+// The compiled list a floor (type 0) or ceiling (type 1) query at (x, z) in
+// the given cell needs to walk
+CompiledList *getCompiledList(
+  CompiledPartitions *c, bool dynamic, s32 cell, s32 type, s16 x, s16 z)
+{
+  CompiledList *list =
+    dynamic ? &c->dynamicLists[cell][type] : &c->staticLists[cell][type];
+  if (!c->fineGrid) return list;
+
+  s32 first = dynamic ? c->dynamicFine[cell][type] : c->staticFine[cell][type];
+  if (first < 0) return list;
+
+  s32 sx = ((x + 0x2000) & 0x3FF) / FINE_GRID_SIZE;
+  s32 sz = ((z + 0x2000) & 0x3FF) / FINE_GRID_SIZE;
+  return &c->fineLists[first + FINE_GRID_DIV * sz + sx];
+}
+
+
 /** 80380690(J) */
 s32 findWallColsFromList(SurfaceNode *triangles, CollisionData *data) {
   s32 numCols = 0;
@@ -418,16 +1192,22 @@ s32 findWallColsFromList(SurfaceNode *triangles, CollisionData *data) {
   while (triangles != NULL) {
     Surface *tri = triangles->head;
     triangles = triangles->tail;
+    STAT_INC(STAT_TRIS);
 
-    if (y < tri->lowerY || y > tri->upperY)
+    if (y < tri->lowerY || y > tri->upperY) {
+      STAT_INC(STAT_WALL_Y_REJECTS);
       continue;
+    }
 
     f32 nx = tri->normal.x;
     f32 ny = tri->normal.y;
     f32 nz = tri->normal.z;
     f32 offset = nx * x + ny * y + nz * z + tri->originOffset;
 
-    if (offset < -radius || offset > radius) continue;
+    if (offset < -radius || offset > radius) {
+      STAT_INC(STAT_WALL_OFFSET_REJECTS);
+      continue;
+    }
 
     f32 y1 = tri->vertex1.y;
     f32 y2 = tri->vertex2.y;
@@ -490,6 +1270,91 @@ s32 findWallColsFromList(SurfaceNode *triangles, CollisionData *data) {
     }
 
     numCols += 1;
+    STAT_INC(STAT_WALL_COLLISIONS);
+  }
+  
+  return numCols;
+}
+
+
+// findWallColsFromList over a compiled list
+s32 findWallColsFromCompiled(
+  CompiledPartitions *c, CompiledList *list, CollisionData *data)
+{
+  s32 numCols = 0;
+
+  f32 x = data->pos.x;
+  f32 y = data->pos.y + data->offsetY;
+  f32 z = data->pos.z;
+
+  f32 radius = data->radius;
+  if (radius > 200.0f) radius = 200.0;
+
+  s32 end = list->start + list->count;
+  for (s32 i = list->start; i < end; i++) {
+    STAT_INC(STAT_TRIS);
+    if (y < c->lowerY[i] || y > c->upperY[i]) {
+      STAT_INC(STAT_WALL_Y_REJECTS);
+      continue;
+    }
+
+    f32 nx = c->nx[i];
+    f32 ny = c->ny[i];
+    f32 nz = c->nz[i];
+    f32 offset = nx * x + ny * y + nz * z + c->originOffset[i];
+
+    if (offset < -radius || offset > radius) {
+      STAT_INC(STAT_WALL_OFFSET_REJECTS);
+      continue;
+    }
+
+    f32 y1 = c->y1[i];
+    f32 y2 = c->y2[i];
+    f32 y3 = c->y3[i];
+
+    if (c->v04[i] & 0x08) {
+      f32 z1 = -c->z1[i];
+      f32 z2 = -c->z2[i];
+      f32 z3 = -c->z3[i];
+      
+      if (nx > 0.0f) {
+        if ((y1 - y) * (z2 - z1) - (z1 - -z) * (y2 - y1) > 0.0f) continue;
+        if ((y2 - y) * (z3 - z2) - (z2 - -z) * (y3 - y2) > 0.0f) continue;
+        if ((y3 - y) * (z1 - z3) - (z3 - -z) * (y1 - y3) > 0.0f) continue;
+      }
+      else {
+        if ((y1 - y) * (z2 - z1) - (z1 - -z) * (y2 - y1) < 0.0f) continue;
+        if ((y2 - y) * (z3 - z2) - (z2 - -z) * (y3 - y2) < 0.0f) continue;
+        if ((y3 - y) * (z1 - z3) - (z3 - -z) * (y1 - y3) < 0.0f) continue;
+      }
+    }
+    else {
+      f32 x1 = c->x1[i];
+      f32 x2 = c->x2[i];
+      f32 x3 = c->x3[i];
+
+      if (nz > 0.0f) {
+        if ((y1 - y) * (x2 - x1) - (x1 - x) * (y2 - y1) > 0.0f) continue;
+        if ((y2 - y) * (x3 - x2) - (x2 - x) * (y3 - y2) > 0.0f) continue;
+        if ((y3 - y) * (x1 - x3) - (x3 - x) * (y1 - y3) > 0.0f) continue;
+      }
+      else {
+        if ((y1 - y) * (x2 - x1) - (x1 - x) * (y2 - y1) < 0.0f) continue;
+        if ((y2 - y) * (x3 - x2) - (x2 - x) * (y3 - y2) < 0.0f) continue;
+        if ((y3 - y) * (x1 - x3) - (x3 - x) * (y1 - y3) < 0.0f) continue;
+      }
+    }
+
+    data->pos.x += nx * (radius - offset);
+    data->pos.z += nz * (radius - offset);
+    
+    if (data->numSurfaces < 4) {
+      data->surfaces[data->numSurfaces] = c->surfaces[i];
+      data->numSurfaces += 1;
+    }
+
+    numCols += 1;
+    STAT_INC(STAT_WALL_COLLISIONS);
   }
   
   return numCols;
@@ -497,7 +1362,7 @@ s32 findWallColsFromList(SurfaceNode *triangles, CollisionData *data) {
 
 
 /** 80380E8C(J) */
-s32 findWallCols(CollisionData *data) {
+s32 worldFindWallCols(CollisionWorld *world, CollisionData *data) {
   s32 totalCols = 0;
   data->numSurfaces = 0;
 
@@ -510,17 +1375,36 @@ s32 findWallCols(CollisionData *data) {
   u32 xidx = ((x + 0x2000) / 0x400) & 0xF;
   u32 zidx = ((z + 0x2000) / 0x400) & 0xF;
 
-  SurfaceNode *dynWalls = dynamicPartition[16 * zidx + xidx].walls;
+  STAT_INC(STAT_WALL_QUERIES);
+
+  CompiledPartitions *c = &world->compiled;
+  if (c->valid) {
+    totalCols += findWallColsFromCompiled(
+      c, &c->dynamicLists[16 * zidx + xidx][2], data);
+    STAT_TAKE(STAT_WALL_DYNAMIC_TRIS, STAT_TRIS);
+    totalCols += findWallColsFromCompiled(
+      c, &c->staticLists[16 * zidx + xidx][2], data);
+    STAT_TAKE(STAT_WALL_STATIC_TRIS, STAT_TRIS);
+    return totalCols;
+  }
+
+  SurfaceNode *dynWalls = world->dynamicPartition[16 * zidx + xidx].walls;
   totalCols += findWallColsFromList(dynWalls, data);
+  STAT_TAKE(STAT_WALL_DYNAMIC_TRIS, STAT_TRIS);
 
-  SurfaceNode *staticWalls = staticPartition[16 * zidx + xidx].walls;
+  SurfaceNode *staticWalls = world->staticPartition[16 * zidx + xidx].walls;
   totalCols += findWallColsFromList(staticWalls, data);
+  STAT_TAKE(STAT_WALL_STATIC_TRIS, STAT_TRIS);
   
-  // numFindWallCalls += 1;
   return totalCols;
 }
 
 
+s32 findWallCols(CollisionData *data) {
+  return worldFindWallCols(&defaultWorld, data);
+}
+
+
 /** 80381038(J) */
 Surface *findTriFromListAbove(
   SurfaceNode *triangles,
@@ -532,6 +1416,7 @@ Surface *findTriFromListAbove(
   while (triangles != NULL) {
     Surface *tri = triangles->head;
     triangles = triangles->tail;
+    STAT_INC(STAT_TRIS);
 
     s32 x1 = tri->vertex1.x;
     s32 z1 = tri->vertex1.z;
@@ -540,9 +1425,18 @@ Surface *findTriFromListAbove(
     s32 x3 = tri->vertex3.x;
     s32 z3 = tri->vertex3.z;
 
-    if ((z1 - z) * (x2 - x1) - (x1 - x) * (z2 - z1) > 0) continue;
-    if ((z2 - z) * (x3 - x2) - (x2 - x) * (z3 - z2) > 0) continue;
-    if ((z3 - z) * (x1 - x3) - (x3 - x) * (z1 - z3) > 0) continue;
+    if ((z1 - z) * (x2 - x1) - (x1 - x) * (z2 - z1) > 0) {
+      STAT_INC(STAT_EDGE1_REJECTS);
+      continue;
+    }
+    if ((z2 - z) * (x3 - x2) - (x2 - x) * (z3 - z2) > 0) {
+      STAT_INC(STAT_EDGE2_REJECTS);
+      continue;
+    }
+    if ((z3 - z) * (x1 - x3) - (x3 - x) * (z1 - z3) > 0) {
+      STAT_INC(STAT_EDGE3_REJECTS);
+      continue;
+    }
 
     // if ((v8035FE10 != 0 && !(tri->v04 & 0x02)) ||
     //   (v8035FE10 == 0 && tri->type != surface_0072))
@@ -552,10 +1446,16 @@ Surface *findTriFromListAbove(
       f32 nz = tri->normal.z;
       f32 oo = tri->originOffset;
 
-      if (ny == 0.0f) continue;
+      if (ny == 0.0f) {
+        STAT_INC(STAT_HEIGHT_REJECTS);
+        continue;
+      }
 
       f32 height = -(x * nx + nz * z + oo) / ny;
-      if (y - (height - -78.0f) > 0.0f) continue;
+      if (y - (height - -78.0f) > 0.0f) {
+        STAT_INC(STAT_HEIGHT_REJECTS);
+        continue;
+      }
 
       *pheight = height;
       return tri;
@@ -566,8 +1466,64 @@ Surface *findTriFromListAbove(
 }
 
 
+// findTriFromListAbove over a compiled list
+Surface *findTriFromCompiledAbove(
+  CompiledPartitions *c,
+  CompiledList *list,
+  s32 x,
+  s32 y,
+  s32 z,
+  f32 *pheight)
+{
+  s32 end = list->start + list->count;
+  for (s32 i = list->start; i < end; i++) {
+    STAT_INC(STAT_TRIS);
+    s32 x1 = c->x1[i];
+    s32 z1 = c->z1[i];
+    s32 x2 = c->x2[i];
+    s32 z2 = c->z2[i];
+    s32 x3 = c->x3[i];
+    s32 z3 = c->z3[i];
+
+    if ((z1 - z) * (x2 - x1) - (x1 - x) * (z2 - z1) > 0) {
+      STAT_INC(STAT_EDGE1_REJECTS);
+      continue;
+    }
+    if ((z2 - z) * (x3 - x2) - (x2 - x) * (z3 - z2) > 0) {
+      STAT_INC(STAT_EDGE2_REJECTS);
+      continue;
+    }
+    if ((z3 - z) * (x1 - x3) - (x3 - x) * (z1 - z3) > 0) {
+      STAT_INC(STAT_EDGE3_REJECTS);
+      continue;
+    }
+
+    f32 nx = c->nx[i];
+    f32 ny = c->ny[i];
+    f32 nz = c->nz[i];
+    f32 oo = c->originOffset[i];
+
+    if (ny == 0.0f) {
+      STAT_INC(STAT_HEIGHT_REJECTS);
+      continue;
+    }
+
+    f32 height = -(x * nx + nz * z + oo) / ny;
+    if (y - (height - -78.0f) > 0.0f) {
+      STAT_INC(STAT_HEIGHT_REJECTS);
+      continue;
+    }
+
+    *pheight = height;
+    return c->surfaces[i];
+  }
+
+  return NULL;
+}
+
+
 /** 80381264(J) */
-f32 findCeil(v3f pos, Surface **pceil) {
+f32 worldFindCeil(CollisionWorld *world, v3f pos, Surface **pceil) {
   f32 dynHeight = 20000.0f;
   f32 height = 20000.0f;
 
@@ -583,22 +1539,49 @@ f32 findCeil(v3f pos, Surface **pceil) {
   u32 xidx = ((x + 0x2000) / 0x400) & 0xF;
   u32 zidx = ((z + 0x2000) / 0x400) & 0xF;
 
-  SurfaceNode *dynCeils = dynamicPartition[16 * zidx + xidx].ceils;
-  Surface *dynCeil = findTriFromListAbove(dynCeils, x, y, z, &dynHeight);
+  Surface *dynCeil;
+  Surface *ceil;
+  CompiledPartitions *c = &world->compiled;
+
+  if (c->valid) {
+    dynCeil = findTriFromCompiledAbove(
+      c, getCompiledList(c, true, 16 * zidx + xidx, 1, x, z),
+      x, y, z, &dynHeight);
+    STAT_TAKE(STAT_CEIL_DYNAMIC_TRIS, STAT_TRIS);
+    ceil = findTriFromCompiledAbove(
+      c, getCompiledList(c, false, 16 * zidx + xidx, 1, x, z),
+      x, y, z, &height);
+    STAT_TAKE(STAT_CEIL_STATIC_TRIS, STAT_TRIS);
+  }
+  else {
+    SurfaceNode *dynCeils = world->dynamicPartition[16 * zidx + xidx].ceils;
+    dynCeil = findTriFromListAbove(dynCeils, x, y, z, &dynHeight);
+    STAT_TAKE(STAT_CEIL_DYNAMIC_TRIS, STAT_TRIS);
   
-  SurfaceNode *staticCeils = staticPartition[16 * zidx + xidx].ceils;
-  Surface *ceil = findTriFromListAbove(staticCeils, x, y, z, &height);
+    SurfaceNode *staticCeils = world->staticPartition[16 * zidx + xidx].ceils;
+    ceil = findTriFromListAbove(staticCeils, x, y, z, &height);
+    STAT_TAKE(STAT_CEIL_STATIC_TRIS, STAT_TRIS);
+  }
   
   if (dynHeight < height) {
     ceil = dynCeil;
     height = dynHeight;
   }
 
+  STAT_INC(STAT_CEIL_QUERIES);
+  if (ceil == NULL)
+    STAT_INC(STAT_CEIL_MISSES);
+
   *pceil = ceil;
   return height;
 }
 
 
+f32 findCeil(v3f pos, Surface **pceil) {
+  return worldFindCeil(&defaultWorld, pos, pceil);
+}
+
+
 /** 8038156C(J) */
 Surface *findTriFromListBelow(
   SurfaceNode *triangles,
@@ -610,6 +1593,7 @@ Surface *findTriFromListBelow(
   while (triangles != NULL) {
     Surface *tri = triangles->head;
     triangles = triangles->tail;
+    STAT_INC(STAT_TRIS);
 
     s32 x1 = tri->vertex1.x;
     s32 z1 = tri->vertex1.z;
@@ -618,9 +1602,18 @@ Surface *findTriFromListBelow(
     s32 x3 = tri->vertex3.x;
     s32 z3 = tri->vertex3.z;
 
-    if ((z1 - z) * (x2 - x1) - (x1 - x) * (z2 - z1) < 0) continue;
-    if ((z2 - z) * (x3 - x2) - (x2 - x) * (z3 - z2) < 0) continue;
-    if ((z3 - z) * (x1 - x3) - (x3 - x) * (z1 - z3) < 0) continue;
+    if ((z1 - z) * (x2 - x1) - (x1 - x) * (z2 - z1) < 0) {
+      STAT_INC(STAT_EDGE1_REJECTS);
+      continue;
+    }
+    if ((z2 - z) * (x3 - x2) - (x2 - x) * (z3 - z2) < 0) {
+      STAT_INC(STAT_EDGE2_REJECTS);
+      continue;
+    }
+    if ((z3 - z) * (x1 - x3) - (x3 - x) * (z1 - z3) < 0) {
+      STAT_INC(STAT_EDGE3_REJECTS);
+      continue;
+    }
 
     // if ((v8035FE10 != 0 && !(tri->v04 & 0x02)) ||
     //   (v8035FE10 == 0 && tri->type != surface_0072))
@@ -630,10 +1623,16 @@ Surface *findTriFromListBelow(
       f32 nz = tri->normal.z;
       f32 oo = tri->originOffset;
 
-      if (ny == 0.0f) continue;
+      if (ny == 0.0f) {
+        STAT_INC(STAT_HEIGHT_REJECTS);
+        continue;
+      }
 
       f32 height = -(x * nx + nz * z + oo) / ny;
-      if (y - (height + -78.0f) < 0.0f) continue;
+      if (y - (height + -78.0f) < 0.0f) {
+        STAT_INC(STAT_HEIGHT_REJECTS);
+        continue;
+      }
 
       *pheight = height;
       return tri;
@@ -644,6 +1643,62 @@ Surface *findTriFromListBelow(
 }
 
 
+// findTriFromListBelow over a compiled list
+Surface *findTriFromCompiledBelow(
+  CompiledPartitions *c,
+  CompiledList *list,
+  s32 x,
+  s32 y,
+  s32 z,
+  f32 *pheight)
+{
+  s32 end = list->start + list->count;
+  for (s32 i = list->start; i < end; i++) {
+    STAT_INC(STAT_TRIS);
+    s32 x1 = c->x1[i];
+    s32 z1 = c->z1[i];
+    s32 x2 = c->x2[i];
+    s32 z2 = c->z2[i];
+    s32 x3 = c->x3[i];
+    s32 z3 = c->z3[i];
+
+    if ((z1 - z) * (x2 - x1) - (x1 - x) * (z2 - z1) < 0) {
+      STAT_INC(STAT_EDGE1_REJECTS);
+      continue;
+    }
+    if ((z2 - z) * (x3 - x2) - (x2 - x) * (z3 - z2) < 0) {
+      STAT_INC(STAT_EDGE2_REJECTS);
+      continue;
+    }
+    if ((z3 - z) * (x1 - x3) - (x3 - x) * (z1 - z3) < 0) {
+      STAT_INC(STAT_EDGE3_REJECTS);
+      continue;
+    }
+
+    f32 nx = c->nx[i];
+    f32 ny = c->ny[i];
+    f32 nz = c->nz[i];
+    f32 oo = c->originOffset[i];
+
+    if (ny == 0.0f) {
+      STAT_INC(STAT_HEIGHT_REJECTS);
+      continue;
+    }
+
+    f32 height = -(x * nx + nz * z + oo) / ny;
+    if (y - (height + -78.0f) < 0.0f) {
+      STAT_INC(STAT_HEIGHT_REJECTS);
+      continue;
+    }
+
+    *pheight = height;
+    return c->surfaces[i];
+  }
+
+  return NULL;
+}
+
+
 /** 80381794(J) */
 f32 findFloorHeight(v3f pos) {
   Surface *floor;
@@ -652,7 +1707,7 @@ f32 findFloorHeight(v3f pos) {
 
 
 /** 80381900(J) */
-f32 findFloor(v3f pos, Surface **pfloor) {
+f32 worldFindFloor(CollisionWorld *world, v3f pos, Surface **pfloor) {
   f32 dynHeight = -11000.0f;
   f32 height = -11000.0f;
 
@@ -668,11 +1723,31 @@ f32 findFloor(v3f pos, Surface **pfloor) {
   u32 xidx = ((x + 0x2000) / 0x400) & 0xF;
   u32 zidx = ((z + 0x2000) / 0x400) & 0xF;
   
-  SurfaceNode *dynFloors = dynamicPartition[16 * zidx + xidx].floors;
-  Surface *dynFloor = findTriFromListBelow(dynFloors, x, y, z, &dynHeight);
+  Surface *dynFloor;
+  Surface *floor;
+  CompiledPartitions *c = &world->compiled;
+
+  if (c->valid) {
+    dynFloor = findTriFromCompiledBelow(
+      c, getCompiledList(c, true, 16 * zidx + xidx, 0, x, z),
+      x, y, z, &dynHeight);
+    STAT_TAKE(STAT_FLOOR_DYNAMIC_TRIS, STAT_TRIS);
+    floor = findTriFromCompiledBelow(
+      c, getCompiledList(c, false, 16 * zidx + xidx, 0, x, z),
+      x, y, z, &height);
+    STAT_TAKE(STAT_FLOOR_STATIC_TRIS, STAT_TRIS);
+  }
+  else {
+    SurfaceNode *dynFloors =
+      world->dynamicPartition[16 * zidx + xidx].floors;
+    dynFloor = findTriFromListBelow(dynFloors, x, y, z, &dynHeight);
+    STAT_TAKE(STAT_FLOOR_DYNAMIC_TRIS, STAT_TRIS);
   
-  SurfaceNode *staticFloors = staticPartition[16 * zidx + xidx].floors;
-  Surface *floor = findTriFromListBelow(staticFloors, x, y, z, &height);
+    SurfaceNode *staticFloors =
+      world->staticPartition[16 * zidx + xidx].floors;
+    floor = findTriFromListBelow(staticFloors, x, y, z, &height);
+    STAT_TAKE(STAT_FLOOR_STATIC_TRIS, STAT_TRIS);
+  }
 
   // if (v8035FE12 == 0 && floor != NULL && floor->type == surface_0012)
   //   floor = findTriFromListBelow(
@@ -680,20 +1755,27 @@ f32 findFloor(v3f pos, Surface **pfloor) {
   // else
   //   v8035FE12 = 0;
 
-  // if (floor == NULL)
-    // numFindFloorMisses += 1;
-  
   if (dynHeight > height) {
     floor = dynFloor;
     height = dynHeight;
   }
+
+  // The game counts a miss when there is no static floor. Without a level
+  // loaded that is every query, so here it means no floor at all.
+  STAT_INC(STAT_FLOOR_QUERIES);
+  if (floor == NULL)
+    STAT_INC(STAT_FLOOR_MISSES);
   
   *pfloor = floor;
-  // numFindFloorCalls += 1;
   return height;
 }
 
 
+f32 findFloor(v3f pos, Surface **pfloor) {
+  return worldFindFloor(&defaultWorld, pos, pfloor);
+}
+
+
 char classifySurface(Surface *s) {
   if (s->normal.y > 0.01)
     return 'f';
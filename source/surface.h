@@ -52,27 +52,149 @@ typedef struct {
 } CollisionData;
 
 
-extern SpatialPartitionCell staticPartition[16 * 16];
-extern SpatialPartitionCell dynamicPartition[16 * 16];
-
-extern SurfaceNode *surfaceNodePool;
-extern Surface *surfacePool;
-
-extern s32 surfaceNodesAllocated;
-extern s32 surfacesAllocated;
-extern s32 numStaticSurfaceNodes;
-extern s32 numStaticSurfaces;
-
+typedef struct {
+  s32 start;
+  s32 count;
+} CompiledList;
+
+
+// Read-only flat copy of both partitions. Each list is a contiguous range of
+// entries in the same order as its SurfaceNode list, stored as one array per
+// field. Built by worldCompilePartitions; adding surfaces or resetting a
+// partition invalidates it, and the queries go back to the SurfaceNode lists.
+//
+// With fineGrid set, the floor and ceiling lists of crowded cells are also
+// split into a finer grid for analysis queries (see worldSetFineGrid).
+// staticFine[cell][j] and dynamicFine[cell][j] are the index in fineLists of
+// the list for the cell's first subcell, or -1 if the list wasn't split.
+typedef struct {
+  bool valid;
+  bool fineGrid;
+  s32 capacity;
+
+  s32 *x1, *y1, *z1;
+  s32 *x2, *y2, *z2;
+  s32 *x3, *y3, *z3;
+  f32 *nx, *ny, *nz;
+  f32 *originOffset;
+  s16 *lowerY;
+  s16 *upperY;
+  s8 *v04;
+  Surface **surfaces;
+
+  CompiledList staticLists[16 * 16][3];
+  CompiledList dynamicLists[16 * 16][3];
+
+  s32 staticFine[16 * 16][2];
+  s32 dynamicFine[16 * 16][2];
+  CompiledList *fineLists;
+  s32 fineListsCapacity;
+} CompiledPartitions;
+
+
+// Each split cell has FINE_GRID_DIV x FINE_GRID_DIV subcells of
+// FINE_GRID_SIZE units. Only lists longer than FINE_GRID_MIN_LIST are split.
+#define FINE_GRID_DIV 8
+#define FINE_GRID_SIZE (0x400 / FINE_GRID_DIV)
+#define FINE_GRID_MIN_LIST 4
+
+
+// The game's surface and node pools are fixed arrays of 2300 and 7000
+// entries. Here they are lists of chunks, allocated as the pools grow and
+// kept until the world is freed. Entries never move, so pointers to them stay
+// valid. Resetting the dynamic partition only moves the allocation counts
+// back to the static watermark, and the chunks are reused.
+#define SURFACE_POOL_CHUNK 1024
+#define SURFACE_NODE_POOL_CHUNK 4096
+
+// Surfaces find their vertices at an s16 offset of 3 per vertex index, as in
+// the game, so a vertex list can only be this long
+#define MAX_COLLISION_VERTICES (0x7FFF / 3)
+
+
+// Everything the collision code reads and writes. The functions prefixed with
+// world operate on an explicit world, so that several can be used side by
+// side (e.g. one per search thread). The unprefixed functions operate on
+// defaultWorld, as in the game.
+typedef struct {
+  SpatialPartitionCell staticPartition[16 * 16];
+  SpatialPartitionCell dynamicPartition[16 * 16];
+
+  SurfaceNode **surfaceNodeChunks;
+  Surface **surfaceChunks;
+  s32 numSurfaceNodeChunks;
+  s32 numSurfaceChunks;
+
+  s32 surfaceNodesAllocated;
+  s32 surfacesAllocated;
+  s32 numStaticSurfaceNodes;
+  s32 numStaticSurfaces;
+
+  // Nodes released by worldUpdateObjectCollisionModel, reused before
+  // allocating new ones
+  SurfaceNode *freeSurfaceNodes;
+
+  // Transformed vertices of the model being loaded, grown to fit the
+  // largest model loaded so far
+  s16 *vertexBuffer;
+  s32 vertexBufferCapacity;
+
+  CompiledPartitions compiled;
+} CollisionWorld;
+
+
+extern CollisionWorld defaultWorld;
+
+
+// Surface i of the pool, for 0 <= i < surfacesAllocated
+static inline Surface *worldSurface(CollisionWorld *world, s32 i) {
+  return &world->surfaceChunks[i / SURFACE_POOL_CHUNK][i % SURFACE_POOL_CHUNK];
+}
+
+
+CollisionWorld *newCollisionWorld(void);
+void freeCollisionWorld(CollisionWorld *world);
+
+Surface *worldAllocSurface(CollisionWorld *world);
+s32 worldSurfaceIndex(CollisionWorld *world, Surface *s);
+void worldInitStaticPartition(CollisionWorld *world);
+void worldAddSurface(CollisionWorld *world, Surface *tri, bool dynamic);
+void worldInitDynamicPartition(CollisionWorld *world);
+void worldLoadStaticSurfaces(CollisionWorld *world, s16 *data);
+void worldCopyStaticSurfaces(CollisionWorld *world, CollisionWorld *src);
+void worldLoadObjectCollisionModel(CollisionWorld *world, Object *curObj);
+void worldLoadObjectCollisionModels(
+  CollisionWorld *world, Object *objects, s32 numObjects);
+void worldUpdateObjectCollisionModel(CollisionWorld *world, Object *curObj);
+void worldCompilePartitions(CollisionWorld *world);
+void worldSetFineGrid(CollisionWorld *world, bool enabled);
+CompiledList *getCompiledList(
+  CompiledPartitions *c, bool dynamic, s32 cell, s32 type, s16 x, s16 z);
+
+f32 worldFindFloor(CollisionWorld *world, v3f pos, Surface **pfloor);
+f32 worldFindCeil(CollisionWorld *world, v3f pos, Surface **pceil);
+s32 worldFindWallCols(CollisionWorld *world, CollisionData *data);
+void worldFindFloorBatch(
+  CollisionWorld *world,
+  const v3f *pts,
+  s32 n,
+  f32 *heights,
+  Surface **floors);
 
 Surface *allocSurface(void);
 void initStaticPartition(void);
 void addSurface(Surface *tri, bool dynamic);
 void initDynamicPartition(void);
 void loadObjectCollisionModel(Object *curObj);
+void updateObjectCollisionModel(Object *curObj);
 
 f32 findFloor(v3f pos, Surface **pfloor);
 f32 findCeil(v3f pos, Surface **pceil);
 s32 findWallCols(CollisionData *data);
+void findFloorBatch(const v3f *pts, s32 n, f32 *heights, Surface **floors);
+
+bool surfaceHasForce(s16 surfaceType);
+s8 surfaceNoCamCollisionFlags(s16 surfaceType);
 
 char classifySurface(Surface *s);
 bool getFloorHeight(Surface *tri, s16 x, s16 z, f32 *pheight);
@@ -1,5 +1,10 @@
 #include "util.h"
 
+#include "simd.h"
+
+#include <stdlib.h>
+#include <string.h>
+
 
 extern s16 atanTable[1025];
 
@@ -97,6 +102,74 @@ void matrixTransposeVecMult(Mtxfp m, v3f *dst, v3f *src) {
 }
 
 
+// Transforms numVerts s16 vertices, (x, y, z) interleaved, by m with each
+// coordinate computed as (s16) (m[0][i]*x + m[1][i]*y + m[2][i]*z + m[3][i]).
+// Each 128 bit half of a vector takes four vertices, loaded as three vectors
+// x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3, which are shuffled into x, y and z
+// rows and back. The operation order and truncation are the same as the
+// scalar loop that handles the rest.
+void transformVertices(Mtxfp m, const s16 *src, s16 *dst, s32 numVerts) {
+  s32 i = 0;
+
+#if LANES > 1
+  vf32 mv[4][3];
+  for (s32 r = 0; r < 4; r++) {
+    for (s32 c = 0; c < 3; c++)
+      mv[r][c] = vf32_set1(m[r][c]);
+  }
+
+  for (; i + LANES <= numVerts; i += LANES) {
+    const s16 *p = src + 3 * i;
+    vf32 a = vf32_load_s16x4(p, 12);
+    vf32 b = vf32_load_s16x4(p + 4, 12);
+    vf32 c = vf32_load_s16x4(p + 8, 12);
+
+    vf32 x = vf32_shuffle(a, vf32_shuffle(b, c, 2, 2, 1, 1), 0, 3, 0, 2);
+    vf32 y = vf32_shuffle(
+      vf32_shuffle(a, b, 1, 1, 0, 0), vf32_shuffle(b, c, 3, 3, 2, 2),
+      0, 2, 0, 2);
+    vf32 z = vf32_shuffle(vf32_shuffle(a, b, 2, 2, 1, 1), c, 0, 2, 0, 3);
+
+    vf32 out[3];
+    for (s32 k = 0; k < 3; k++) {
+      vf32 v = vf32_mul(mv[0][k], x);
+      v = vf32_add(v, vf32_mul(mv[1][k], y));
+      v = vf32_add(v, vf32_mul(mv[2][k], z));
+      out[k] = vf32_add(v, mv[3][k]);
+    }
+    x = out[0];
+    y = out[1];
+    z = out[2];
+
+    a = vf32_shuffle(
+      vf32_shuffle(x, y, 0, 0, 0, 0), vf32_shuffle(z, x, 0, 0, 1, 1),
+      0, 2, 0, 2);
+    b = vf32_shuffle(
+      vf32_shuffle(y, z, 1, 1, 1, 1), vf32_shuffle(x, y, 2, 2, 2, 2),
+      0, 2, 0, 2);
+    c = vf32_shuffle(
+      vf32_shuffle(z, x, 2, 2, 3, 3), vf32_shuffle(y, z, 3, 3, 3, 3),
+      0, 2, 0, 2);
+
+    s16 *q = dst + 3 * i;
+    vs32_store_s16x4(q, 12, vf32_to_s32_trunc(a));
+    vs32_store_s16x4(q + 4, 12, vf32_to_s32_trunc(b));
+    vs32_store_s16x4(q + 8, 12, vf32_to_s32_trunc(c));
+  }
+#endif
+
+  for (; i < numVerts; i++) {
+    s16 vx = src[3 * i];
+    s16 vy = src[3 * i + 1];
+    s16 vz = src[3 * i + 2];
+
+    dst[3 * i] = (s16) (m[0][0]*vx + m[1][0]*vy + m[2][0]*vz + m[3][0]);
+    dst[3 * i + 1] = (s16) (m[0][1]*vx + m[1][1]*vy + m[2][1]*vz + m[3][1]);
+    dst[3 * i + 2] = (s16) (m[0][2]*vx + m[1][2]*vy + m[2][2]*vz + m[3][2]);
+  }
+}
+
+
 f32 incTowardAsymF(f32 speed, f32 target, f32 posDelta, f32 negDelta) {
   if (speed < target) {
     if (speed + posDelta > target)
@@ -167,6 +240,36 @@ s16 max3(s16 t1, s16 t2, s16 t3) {
 }
 
 
+// Decimal only, so that zero padded indices aren't read as octal
+bool parseInt(const char *s, s32 *value) {
+  char *end;
+  long v = strtol(s, &end, 10);
+  if (end == s || *end != '\0' || v != (s32) v) return false;
+  *value = (s32) v;
+  return true;
+}
+
+
+// FIRST or FIRST-LAST, an index or roll range within 0 to 0xFF
+bool parseRange(const char *s, s32 *first, s32 *last) {
+  char buf[32];
+  if (strlen(s) >= sizeof(buf)) return false;
+  strcpy(buf, s);
+
+  char *dash = strchr(buf, '-');
+  if (dash == NULL) {
+    if (!parseInt(buf, first)) return false;
+    *last = *first;
+  }
+  else {
+    *dash = '\0';
+    if (!parseInt(buf, first) || !parseInt(dash + 1, last)) return false;
+  }
+
+  return *first >= 0 && *first <= *last && *last <= 0xFF;
+}
+
+
 u32 sineTableRaw[0x1400] = {
   0x00000000,0x3AC90FD5,0x3B490FC6,0x3B96CBC1,0x3BC90F88,0x3BFB5330,0x3C16CB58,
   0x3C2FED02,0x3C490E90,0x3C622FFF,0x3C7B514B,0x3C8A3938,0x3C96C9B6,0x3CA35A1C,
@@ -8,10 +8,12 @@
 typedef int8_t s8; 
 typedef int16_t s16;
 typedef int32_t s32;
+typedef int64_t s64;
 
 typedef uint8_t u8; 
 typedef uint16_t u16;
 typedef uint32_t u32;
+typedef uint64_t u64;
 
 typedef float f32;
 typedef double f64;
@@ -54,6 +56,7 @@ s16 atan2xy(f32 x, f32 y);
 void matrixFromTransAndRot(Mtxfp dst, v3f *translate, v3h *rotate);
 void matrixVecMult(Mtxfp m, v3f *dst, v3f *src);
 void matrixTransposeVecMult(Mtxfp m, v3f *dst, v3f *src);
+void transformVertices(Mtxfp m, const s16 *src, s16 *dst, s32 numVerts);
 f32 incTowardAsymF(f32 speed, f32 target, f32 posDelta, f32 negDelta);
 bool incTowardSymFP(f32 *x, f32 target, f32 delta);
 u16 randomU16(void);
@@ -61,6 +64,10 @@ s32 randomUnit();
 s16 min3(s16 t1, s16 t2, s16 t3);
 s16 max3(s16 t1, s16 t2, s16 t3);
 
+// Command line parsing shared by the tools
+bool parseInt(const char *s, s32 *value);
+bool parseRange(const char *s, s32 *first, s32 *last);
+
 
 extern u32 sineTableRaw[0x1400];
 
@@ -0,0 +1,446 @@
+#include "object.h"
+#include "search.h"
+#include "snapshot.h"
+#include "spotcache.h"
+#include "spots.h"
+#include "spotstore.h"
+#include "stats.h"
+#include "surface.h"
+#include "util.h"
+
+#include <GLFW/glfw3.h>
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+Object shipInst;
+Object *ship = &shipInst;
+ShipSnapshots *shipSnapshots;
+SpotCache pedroCache;
+SpotStore pedroSpots;
+const SpotStore *pedroStore; // pedroCache.store, or pedroSpots if uncached
+SearchParams searchParams;
+
+#define PEDRO_CACHE_PATH "pedro-spots.bin"
+
+
+SpotBuffer spotsByIndex[0x100];
+
+
+// Keeps each index's spots for rendering
+void keepVolatileSpots(void *data, s32 index, SpotBuffer *spots) {
+  (void) data;
+  printf("Index %d: %d\n", index, spots->count);
+  fflush(stdout);
+  spotsByIndex[index] = *spots;
+  initSpotBuffer(spots);
+}
+
+
+void computeAllVolatileSpots(ShipSnapshots *snapshots, s32 numThreads) {
+  printf("Computing volatile spots\n");
+  runSearch(findVolatileSpots, snapshots, &searchParams, 0, 0xFF,
+    numThreads, keepVolatileSpots, NULL);
+}
+
+
+void addPedroSpots(void *data, s32 index, SpotBuffer *spots) {
+  printf("Index %d: %d\n", index, spots->count);
+  fflush(stdout);
+  addStoreSpots((SpotStoreBuilder *) data, index, spots->spots, spots->count);
+}
+
+
+// Each index's spots go into the store as soon as they're found, so only a
+// few indices are held at once
+void computeAllPedroSpots(
+  ShipSnapshots *snapshots, s32 numThreads, SpotStore *store)
+{
+  printf("Computing Pedro spots\n");
+  SpotStoreBuilder builder;
+  initSpotStoreBuilder(&builder, 0x100);
+  runSearch(findPedroSpots, snapshots, &searchParams, 0, 0xFF,
+    numThreads, addPedroSpots, &builder);
+  finishSpotStore(&builder, store);
+}
+
+
+struct {
+  v3f pos;
+  f32 pitch;
+  f32 yaw;
+} camera = {{3080, 2520, 2375}, 0, 3.14159f / 2.0f};
+
+
+// Buffer objects are GL 1.5, past the GL 1.1 that Windows' opengl32 exports,
+// so their entry points are looked up once there is a context. Without them,
+// vertices are drawn from client memory instead.
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_STREAM_DRAW 0x88E0
+#define GL_STATIC_DRAW 0x88E4
+#endif
+
+#ifdef WIN32
+#define GL_ENTRY __stdcall
+#else
+#define GL_ENTRY
+#endif
+
+typedef void (GL_ENTRY *GenBuffersProc)(GLsizei n, GLuint *buffers);
+typedef void (GL_ENTRY *BindBufferProc)(GLenum target, GLuint buffer);
+typedef void (GL_ENTRY *BufferDataProc)(
+  GLenum target, ptrdiff_t size, const void *data, GLenum usage);
+
+GenBuffersProc genBuffers;
+BindBufferProc bindBuffer;
+BufferDataProc bufferData;
+
+
+void loadBufferFunctions(GLFWwindow *window) {
+  s32 major = glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MAJOR);
+  s32 minor = glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MINOR);
+  if (major > 1 || (major == 1 && minor >= 5)) {
+    genBuffers = (GenBuffersProc) glfwGetProcAddress("glGenBuffers");
+    bindBuffer = (BindBufferProc) glfwGetProcAddress("glBindBuffer");
+    bufferData = (BufferDataProc) glfwGetProcAddress("glBufferData");
+  }
+
+  if (genBuffers == NULL || bindBuffer == NULL || bufferData == NULL) {
+    genBuffers = NULL;
+    bindBuffer = NULL;
+    bufferData = NULL;
+    printf("No vertex buffers, drawing from client memory\n");
+  }
+}
+
+
+GLFWwindow *openWindow(void) {
+  glfwInit();
+
+  GLFWwindow *window =
+    glfwCreateWindow(480, 480, "JRB Ship Afloat", NULL, NULL);
+  glfwMakeContextCurrent(window);
+  loadBufferFunctions(window);
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(GL_LEQUAL);
+
+  return window;
+}
+
+
+void updateCamera(GLFWwindow *window) {
+  f32 forward = 0;
+  f32 sideways = 0;
+  f32 upward = 0;
+
+  if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) forward += 1;
+  if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) forward -= 1;
+  if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) sideways += 1;
+  if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) sideways -= 1;
+  if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) upward += 1;
+  if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) upward -= 1;
+
+  f32 mag = sqrtf(forward*forward + sideways*sideways + upward*upward);
+  if (mag != 0) {
+    forward /= mag;
+    sideways /= mag;
+    upward /= mag;
+
+    f32 speed = 35.0f;
+    forward *= speed;
+    sideways *= speed;
+    upward *= speed;
+
+    camera.pos.x += forward * sinf(camera.yaw);
+    camera.pos.z += forward * cosf(camera.yaw);
+
+    camera.pos.x += sideways * sinf(camera.yaw - 3.1415926f / 2.0f);
+    camera.pos.z += sideways * cosf(camera.yaw - 3.1415926f / 2.0f);
+
+    camera.pos.y += upward;
+  }
+
+  f32 yaw = 0;
+  f32 pitch = 0;
+
+  if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) yaw += 1;
+  if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) yaw -= 1;
+  if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) pitch += 1;
+  if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) pitch -= 1;
+
+  camera.yaw += yaw * 0.03f;
+  camera.pitch += pitch * 0.03f;
+}
+
+
+// The ship doesn't change once its snapshots are built, so the triangles of
+// every index go into one vertex buffer up front, back to back. Index i's
+// are vertices [shipFirstVertex[i], shipFirstVertex[i + 1]). Spots are put
+// in their own buffer whenever the index changes. Without buffer objects,
+// the buffer ids stay 0 and the vertices are kept in shipVertices and
+// spotVertices instead.
+
+typedef struct {
+  v3f pos;
+  f32 color[4];
+} ShipVertex;
+
+
+GLuint shipBuffer;
+ShipVertex *shipVertices;
+s32 shipFirstVertex[0x101];
+
+GLuint spotBuffer;
+v3f *spotVertices;
+s32 spotVerticesCapacity;
+s32 numSpotVertices;
+s32 spotBufferIndex = -1;
+
+
+// Array pointer for data at offset in the bound buffer, or in the client
+// copy when there is no buffer
+const void *vertexData(GLuint buffer, const void *client, size_t offset) {
+  if (buffer != 0) return (const void *) offset;
+  return (const char *) client + offset;
+}
+
+
+void bindArrayBuffer(GLuint buffer) {
+  if (bindBuffer != NULL)
+    bindBuffer(GL_ARRAY_BUFFER, buffer);
+}
+
+
+void setShipVertex(ShipVertex *v, v3h *p, const f32 *color) {
+  v->pos = (v3f) { p->x, p->y, p->z };
+  for (s32 i = 0; i < 4; i++)
+    v->color[i] = color[i];
+}
+
+
+void buildShipBuffer(ShipSnapshots *snapshots) {
+  static const f32 floorColor[4] = { 0.5f, 0.5f, 1, 1 };
+  static const f32 ceilColor[4] = { 1, 0.5f, 0.5f, 1 };
+  static const f32 wallColor[4] = { 0.3f, 0.8f, 0.3f, 1 };
+
+  s32 numVertices = 0;
+  for (s32 i = 0; i < 0x100; i++) {
+    shipFirstVertex[i] = numVertices;
+    numVertices += 3 * shipSnapshotWorld(snapshots, i)->surfacesAllocated;
+  }
+  shipFirstVertex[0x100] = numVertices;
+
+  ShipVertex *vertices =
+    (ShipVertex *) malloc(numVertices * sizeof(ShipVertex));
+  if (vertices == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  ShipVertex *v = vertices;
+  for (s32 i = 0; i < 0x100; i++) {
+    CollisionWorld *world = shipSnapshotWorld(snapshots, i);
+    for (int j = 0; j < world->surfacesAllocated; j++) {
+      Surface *s = worldSurface(world, j);
+
+      const f32 *color = wallColor;
+      switch (classifySurface(s)) {
+      case 'f': color = floorColor; break;
+      case 'c': color = ceilColor; break;
+      }
+
+      setShipVertex(v++, &s->vertex1, color);
+      setShipVertex(v++, &s->vertex2, color);
+      setShipVertex(v++, &s->vertex3, color);
+    }
+  }
+
+  if (genBuffers == NULL) {
+    shipVertices = vertices;
+    return;
+  }
+
+  genBuffers(1, &shipBuffer);
+  bindBuffer(GL_ARRAY_BUFFER, shipBuffer);
+  bufferData(GL_ARRAY_BUFFER, numVertices * sizeof(ShipVertex), vertices,
+    GL_STATIC_DRAW);
+  bindBuffer(GL_ARRAY_BUFFER, 0);
+
+  free(vertices);
+}
+
+
+// Draws the filled triangles, then their outlines from the same vertices
+void renderShipSurfaces(s32 index) {
+  s32 first = shipFirstVertex[index];
+  s32 count = shipFirstVertex[index + 1] - first;
+
+  bindArrayBuffer(shipBuffer);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(3, GL_FLOAT, sizeof(ShipVertex),
+    vertexData(shipBuffer, shipVertices, offsetof(ShipVertex, pos)));
+  glColorPointer(4, GL_FLOAT, sizeof(ShipVertex),
+    vertexData(shipBuffer, shipVertices, offsetof(ShipVertex, color)));
+  glDrawArrays(GL_TRIANGLES, first, count);
+  glDisableClientState(GL_COLOR_ARRAY);
+
+  glColor3f(0, 0, 0);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+  glDrawArrays(GL_TRIANGLES, first, count);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+  glDisableClientState(GL_VERTEX_ARRAY);
+  bindArrayBuffer(0);
+}
+
+
+// Fills the spot buffer with a square (two triangles) per spot at index
+void buildSpotBuffer(s32 index) {
+  static SpotBuffer indexSpots;
+
+  clearSpotBuffer(&indexSpots);
+  getStoreSpots(pedroStore, index, &indexSpots);
+
+  numSpotVertices = 6 * indexSpots.count;
+  if (numSpotVertices > spotVerticesCapacity) {
+    spotVerticesCapacity = numSpotVertices;
+    spotVertices = (v3f *) realloc(spotVertices,
+      spotVerticesCapacity * sizeof(v3f));
+    if (spotVertices == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+  }
+
+  f32 size = 4;
+  v3f *v = spotVertices;
+  for (s32 i = 0; i < indexSpots.count; i++) {
+    const Spot *s = &indexSpots.spots[i];
+    v3f p00 = { s->x, s->y, s->z };
+    v3f p10 = { s->x + size, s->y, s->z };
+    v3f p01 = { s->x, s->y, s->z + size };
+    v3f p11 = { s->x + size, s->y, s->z + size };
+    *v++ = p00;
+    *v++ = p10;
+    *v++ = p01;
+    *v++ = p10;
+    *v++ = p01;
+    *v++ = p11;
+  }
+
+  if (genBuffers != NULL) {
+    if (spotBuffer == 0)
+      genBuffers(1, &spotBuffer);
+    bindBuffer(GL_ARRAY_BUFFER, spotBuffer);
+    bufferData(GL_ARRAY_BUFFER, numSpotVertices * sizeof(v3f), spotVertices,
+      GL_STREAM_DRAW);
+    bindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  spotBufferIndex = index;
+}
+
+
+void renderSpots(s32 index) {
+  if (index != spotBufferIndex)
+    buildSpotBuffer(index);
+
+  glColor3f(1, 1, 1);
+  bindArrayBuffer(spotBuffer);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, sizeof(v3f),
+    vertexData(spotBuffer, spotVertices, 0));
+  glDrawArrays(GL_TRIANGLES, 0, numSpotVertices);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  bindArrayBuffer(0);
+}
+
+
+void render(GLFWwindow *window) {
+  int index = ((u32) ship->v0F4 / 0x100) % 0x100;
+
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  glLoadIdentity();
+  glFrustum(-1, 1, -1, 1, 2, 10000);
+  glRotatef(-camera.pitch * 180.0f / 3.1415926f, 1, 0, 0);
+  glRotatef(-camera.yaw * 180.0f / 3.1415926f, 0, 1, 0);
+  glRotatef(180, 0, 1, 0);
+  glTranslatef(-camera.pos.x, -camera.pos.y, -camera.pos.z);
+
+  renderShipSurfaces(index);
+  renderSpots(index);
+
+  glfwSwapBuffers(window);
+  glfwPollEvents();
+}
+
+
+int main(int argc, char **argv) {
+  s32 numThreads = argc > 1 ? atoi(argv[1]) : numCpus();
+
+  initSearchParams(&searchParams);
+  initJrbShipAfloat(ship);
+  initStaticPartition();
+  shipSnapshots = buildShipSnapshots(ship, NULL);
+  // computeAllVolatileSpots(shipSnapshots, numThreads);
+
+  u64 pedroKey = pedroSpotsKey(ship, &searchParams);
+  if (mapSpotCache(&pedroCache, PEDRO_CACHE_PATH, pedroKey)) {
+    printf("Loaded Pedro spots from %s\n", PEDRO_CACHE_PATH);
+    pedroStore = &pedroCache.store;
+  }
+  else {
+    computeAllPedroSpots(shipSnapshots, numThreads, &pedroSpots);
+    pedroStore = &pedroSpots;
+
+    // The cache only saves the search next time, so if it can't be written
+    // the spots are drawn from memory instead
+    if (writeSpotCache(PEDRO_CACHE_PATH, pedroKey, &pedroSpots) &&
+      mapSpotCache(&pedroCache, PEDRO_CACHE_PATH, pedroKey))
+    {
+      freeSpotStore(&pedroSpots);
+      pedroStore = &pedroCache.store;
+    }
+    else {
+      fprintf(stderr, "Failed to write %s, Pedro spots won't be cached\n",
+        PEDRO_CACHE_PATH);
+    }
+  }
+
+  printStats(stdout);
+
+  GLFWwindow *window = openWindow();
+  buildShipBuffer(shipSnapshots);
+
+  double accumTime = 0;
+  double lastTime = glfwGetTime();
+
+  while (!glfwWindowShouldClose(window)) {
+    double currentTime = glfwGetTime();
+    accumTime += currentTime - lastTime;
+    lastTime = currentTime;
+    while (accumTime >= 1.0/30) {
+      updatePlatform(ship);
+
+      updateCamera(window);
+
+      accumTime -= 1.0/30;
+    }
+
+    render(window);
+  }
+
+  glfwTerminate();
+  return 0;
+}